@@ -0,0 +1,148 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * batch.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "chessfunc.h"
+#include "batch.h"
+
+// Masks that stop shifted bitboards wrapping from one side of the board to
+// the other. Squares are numbered x + 8y, so file a is bit 0 of each byte.
+#define NOT_FILE_A (0xfefefefefefefefeUL)
+#define NOT_FILE_H (0x7f7f7f7f7f7f7f7fUL)
+#define NOT_FILES_AB (0xfcfcfcfcfcfcfcfcUL)
+#define NOT_FILES_GH (0x3f3f3f3f3f3f3f3fUL)
+#define ALL_SQUARES (~0UL)
+
+// One position at a time.
+#define KERNEL_T Bitboard
+#define KERNEL_LANES 1
+#define KERNEL(name) scalar_##name
+#define KERNEL_TARGET
+#include "batch_kernel.h"
+#undef KERNEL_T
+#undef KERNEL_LANES
+#undef KERNEL
+#undef KERNEL_TARGET
+
+#if defined(__x86_64__) || defined(__i386__)
+// BATCH_LANES positions at a time in 256 bit registers. Only these
+// functions use AVX2, so the program still runs on CPUs without it.
+typedef Bitboard BitboardVector __attribute__((vector_size(BATCH_LANES * sizeof(Bitboard))));
+#define KERNEL_T BitboardVector
+#define KERNEL_LANES BATCH_LANES
+#define KERNEL(name) avx2_##name
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#include "batch_kernel.h"
+#undef KERNEL_T
+#undef KERNEL_LANES
+#undef KERNEL
+#undef KERNEL_TARGET
+#endif
+
+
+void init_batch(PositionBatch *batch, size_t capacity)
+{
+    // Allocates room for `capacity` positions. Every array is rounded up to
+    // a whole number of vectors and zeroed, so the kernels never need a
+    // separate loop for the last few positions.
+
+    capacity = (capacity + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    batch->count = 0;
+    batch->capacity = capacity;
+    for (int c = 0; c < 2; c++) {
+        for (int t = 0; t < NUM_PIECE_TYPES; t++)
+            batch->pieces[c][t] = (Bitboard*) calloc(capacity, sizeof(Bitboard));
+        batch->attacks[c] = (Bitboard*) calloc(capacity, sizeof(Bitboard));
+    }
+    batch->turn = (unsigned char*) calloc(capacity, sizeof(unsigned char));
+    batch->mobility = (unsigned short*) calloc(capacity, sizeof(unsigned short));
+    batch->in_check = (bool*) calloc(capacity, sizeof(bool));
+}
+
+
+void free_batch(PositionBatch *batch)
+{
+    // Frees the arrays allocated by `init_batch`.
+
+    for (int c = 0; c < 2; c++) {
+        for (int t = 0; t < NUM_PIECE_TYPES; t++)
+            free(batch->pieces[c][t]);
+        free(batch->attacks[c]);
+    }
+    free(batch->turn);
+    free(batch->mobility);
+    free(batch->in_check);
+}
+
+
+void clear_batch(PositionBatch *batch)
+{
+    // Empties the batch so it can be refilled.
+
+    for (int c = 0; c < 2; c++) {
+        for (int t = 0; t < NUM_PIECE_TYPES; t++)
+            memset(batch->pieces[c][t], 0, batch->count * sizeof(Bitboard));
+    }
+    memset(batch->turn, 0, batch->count);
+    batch->count = 0;
+}
+
+
+bool add_to_batch(PositionBatch *batch, Board *board)
+{
+    // Appends the position on `board`. Returns false if the batch is full.
+
+    if (batch->count == batch->capacity)
+        return false;
+
+    size_t i = batch->count++;
+    for (int sq = 0; sq < BOARD_DIM * BOARD_DIM; sq++) {
+        Piece p = *(board->arr + sq);
+        if (p == 0)
+            continue;
+        batch->pieces[COLOR_INDEX(p & COLOR_BITMASK)][(p & PIECE_BITMASK) - 1][i] |= (Bitboard) 1 << sq;
+    }
+    batch->turn[i] = COLOR_INDEX(board->turn);
+    return true;
+}
+
+
+bool batch_avx2_available(void)
+{
+    // Returns true if the CPU running the program supports AVX2.
+
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+
+BatchKernel compute_batch(PositionBatch *batch, BatchKernel kernel)
+{
+    // Computes the attacks, mobility and check status of every position in
+    // the batch. BATCH_AUTO uses AVX2 when the CPU has it; asking for AVX2
+    // on a CPU without it falls back to the scalar kernel. Returns the
+    // kernel that was used.
+
+    if (kernel != BATCH_SCALAR && batch_avx2_available())
+        kernel = BATCH_AVX2;
+    else
+        kernel = BATCH_SCALAR;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == BATCH_AVX2) {
+        avx2_compute(batch);
+        return kernel;
+    }
+#endif
+    scalar_compute(batch);
+    return kernel;
+}
@@ -0,0 +1,51 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * batch.h
+*/
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chessfunc.h"
+
+// Attack sets, mobility and check status for many positions at once. The
+// positions are stored as one array per kind of piece (structure of
+// arrays), so a vector register can hold the same bitboard of several
+// positions and every attack is found with shifts and masks, without
+// looking at squares one by one. With AVX2 four positions are handled per
+// instruction; the scalar kernel does the same work one position at a time.
+// https://www.chessprogramming.org/Kogge-Stone_Algorithm
+#define BATCH_LANES (4)
+#define NUM_PIECE_TYPES (6)
+
+typedef enum {
+    BATCH_AUTO,
+    BATCH_SCALAR,
+    BATCH_AVX2
+} BatchKernel;
+
+typedef struct {
+    size_t count, capacity;
+    // Inputs, indexed by position. `pieces[c][t]` holds the pieces of type
+    // `t + 1` (PAWN...KING) and color COLOR_INDEX `c`.
+    Bitboard *pieces[2][NUM_PIECE_TYPES];
+    unsigned char *turn;            // COLOR_INDEX of the side to move.
+    // Results of `compute_batch`.
+    Bitboard *attacks[2];           // Squares attacked by each color, including defended ones.
+    unsigned short *mobility;       // Squares each of the side to move's pieces other than
+                                    // pawns attacks and its side doesn't occupy, summed.
+    bool *in_check;                 // Whether the side to move is in check.
+} PositionBatch;
+
+
+void init_batch(PositionBatch *batch, size_t capacity);
+void free_batch(PositionBatch *batch);
+void clear_batch(PositionBatch *batch);
+bool add_to_batch(PositionBatch *batch, Board *board);
+bool batch_avx2_available(void);
+BatchKernel compute_batch(PositionBatch *batch, BatchKernel kernel);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * batch_kernel.h
+*/
+
+// The body of a batch kernel, included by batch.c once per instruction set.
+// Before including it, define:
+//   KERNEL_T       Type holding KERNEL_LANES bitboards; it must support the
+//                  C bitwise and shift operators, as GCC vector types do.
+//   KERNEL_LANES   Positions handled per step.
+//   KERNEL(name)   Prefixes `name` so each copy's functions are distinct.
+//   KERNEL_TARGET  Function attributes selecting the instruction set.
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(load)(const Bitboard *p)
+{
+    KERNEL_T v;
+    memcpy(&v, p, sizeof(KERNEL_T));
+    return v;
+}
+
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(slide_left)(KERNEL_T gen, KERNEL_T empty, int shift, Bitboard mask)
+{
+    // Squares attacked along one direction that moves to higher bit
+    // numbers, stopping at the first occupied square. Doubling the step
+    // each round covers the 7 squares in 3 rounds.
+
+    empty &= mask;
+    gen |= empty & (gen << shift);
+    empty &= empty << shift;
+    gen |= empty & (gen << (2 * shift));
+    empty &= empty << (2 * shift);
+    gen |= empty & (gen << (4 * shift));
+    return (gen << shift) & mask;
+}
+
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(slide_right)(KERNEL_T gen, KERNEL_T empty, int shift, Bitboard mask)
+{
+    // As `slide_left`, towards lower bit numbers.
+
+    empty &= mask;
+    gen |= empty & (gen >> shift);
+    empty &= empty >> shift;
+    gen |= empty & (gen >> (2 * shift));
+    empty &= empty >> (2 * shift);
+    gen |= empty & (gen >> (4 * shift));
+    return (gen >> shift) & mask;
+}
+
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(diagonal_attacks)(KERNEL_T pieces, KERNEL_T empty)
+{
+    return KERNEL(slide_left)(pieces, empty, 9, NOT_FILE_A) | KERNEL(slide_left)(pieces, empty, 7, NOT_FILE_H) |
+        KERNEL(slide_right)(pieces, empty, 7, NOT_FILE_A) | KERNEL(slide_right)(pieces, empty, 9, NOT_FILE_H);
+}
+
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(straight_attacks)(KERNEL_T pieces, KERNEL_T empty)
+{
+    return KERNEL(slide_left)(pieces, empty, 1, NOT_FILE_A) | KERNEL(slide_right)(pieces, empty, 1, NOT_FILE_H) |
+        KERNEL(slide_left)(pieces, empty, 8, ALL_SQUARES) | KERNEL(slide_right)(pieces, empty, 8, ALL_SQUARES);
+}
+
+
+static inline KERNEL_TARGET KERNEL_T KERNEL(type_attacks)(int type, int color, KERNEL_T p, KERNEL_T empty)
+{
+    // Squares attacked by the pieces `p`, all of PieceType `type` and
+    // COLOR_INDEX `color`.
+
+    KERNEL_T one, two, sides, row;
+    switch (type) {
+        case PAWN:
+            // White pawns attack towards rank 8, which is bit 0.
+            if (color == COLOR_INDEX(WHITE))
+                return ((p >> 7) & NOT_FILE_A) | ((p >> 9) & NOT_FILE_H);
+            return ((p << 9) & NOT_FILE_A) | ((p << 7) & NOT_FILE_H);
+        case KNIGHT:
+            one = ((p >> 1) & NOT_FILE_H) | ((p << 1) & NOT_FILE_A);
+            two = ((p >> 2) & NOT_FILES_GH) | ((p << 2) & NOT_FILES_AB);
+            return (one << 16) | (one >> 16) | (two << 8) | (two >> 8);
+        case BISHOP:
+            return KERNEL(diagonal_attacks)(p, empty);
+        case ROOK:
+            return KERNEL(straight_attacks)(p, empty);
+        case QUEEN:
+            return KERNEL(diagonal_attacks)(p, empty) | KERNEL(straight_attacks)(p, empty);
+        default:
+            sides = ((p << 1) & NOT_FILE_A) | ((p >> 1) & NOT_FILE_H);
+            row = p | sides;
+            return sides | (row << 8) | (row >> 8);
+    }
+}
+
+
+static inline KERNEL_TARGET bool KERNEL(any)(KERNEL_T v)
+{
+    // Whether any lane of `v` is non-zero.
+
+    Bitboard lanes[KERNEL_LANES], all = 0;
+    memcpy(lanes, &v, sizeof(KERNEL_T));
+    for (int l = 0; l < KERNEL_LANES; l++)
+        all |= lanes[l];
+    return all != 0;
+}
+
+
+static inline KERNEL_TARGET void KERNEL(add_mobility)(KERNEL_T attacks, int color, size_t i, PositionBatch *batch)
+{
+    // Adds the squares in `attacks` to the mobility of the positions in
+    // this step where `color` is to move.
+
+    Bitboard lanes[KERNEL_LANES];
+    memcpy(lanes, &attacks, sizeof(KERNEL_T));
+    for (int l = 0; l < KERNEL_LANES; l++) {
+        if (batch->turn[i + l] == color)
+            batch->mobility[i + l] += __builtin_popcountl(lanes[l]);
+    }
+}
+
+
+static KERNEL_TARGET void KERNEL(compute)(PositionBatch *batch)
+{
+    // Fills in the results for every position. The arrays are padded to a
+    // whole number of steps, so the last step reads and writes zeros.
+
+    for (size_t i = 0; i < batch->count; i += KERNEL_LANES) {
+        KERNEL_T pieces[2][NUM_PIECE_TYPES], own[2];
+        for (int c = 0; c < 2; c++) {
+            own[c] = KERNEL(load)(batch->pieces[c][0] + i);
+            pieces[c][0] = own[c];
+            for (int t = 1; t < NUM_PIECE_TYPES; t++) {
+                pieces[c][t] = KERNEL(load)(batch->pieces[c][t] + i);
+                own[c] |= pieces[c][t];
+            }
+        }
+        KERNEL_T empty = ~(own[0] | own[1]);
+
+        for (int l = 0; l < KERNEL_LANES; l++)
+            batch->mobility[i + l] = 0;
+
+        for (int c = 0; c < 2; c++) {
+            KERNEL_T attacks = KERNEL(type_attacks)(PAWN, c, pieces[c][PAWN - 1], empty);
+            for (int t = KNIGHT; t <= KING; t++) {
+                attacks |= KERNEL(type_attacks)(t, c, pieces[c][t - 1], empty);
+                // Mobility is counted piece by piece, so a square two rooks
+                // attack counts twice. Each round takes the lowest piece of
+                // this type from every lane.
+                KERNEL_T rest = pieces[c][t - 1];
+                while (KERNEL(any)(rest)) {
+                    KERNEL_T piece = rest & -rest;
+                    rest ^= piece;
+                    KERNEL(add_mobility)(KERNEL(type_attacks)(t, c, piece, empty) & ~own[c], c, i, batch);
+                }
+            }
+            memcpy(batch->attacks[c] + i, &attacks, sizeof(KERNEL_T));
+        }
+
+        for (int l = 0; l < KERNEL_LANES; l++) {
+            int turn = batch->turn[i + l];
+            batch->in_check[i + l] = (batch->attacks[!turn][i + l] & batch->pieces[turn][KING - 1][i + l]) != 0;
+        }
+    }
+}
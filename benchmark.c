@@ -0,0 +1,506 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * benchmark.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chessfunc.h"
+#include "batch.h"
+#include "nnue.h"
+#include "engine.h"
+
+// Timings of the individual rules functions, so a change in perft speed
+// can be traced to the function responsible. Each benchmark runs a batch
+// of calls over a fixed set of positions; a batch is timed as a whole and
+// divided by its number of calls, and the median and 99th percentile are
+// taken over many batches after some untimed warm-up batches.
+#define MAX_SAMPLES (100000)
+#define MAX_BENCHMARKS (32)
+#define MAX_MOVES (4096)
+#define NAME_LEN (32)
+// Batches without per-batch setup repeat their calls until they take at
+// least this long, so the clock's resolution doesn't matter.
+#define MIN_BATCH_NS (20000)
+// The corpus is repeated this many times for the batched attack kernels.
+#define BATCH_COPIES (128)
+
+// Standard test positions: the start, "Kiwipete" and the other perft
+// positions from chessprogramming.org, plus a few middlegames and endgames.
+static char *CORPUS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "2r3k1/pp3ppp/4p3/3q4/3P4/P4Q2/1P3PPP/2R3K1 b - - 0 25",
+    "8/8/3k4/8/3K4/3Q4/8/8 w - - 0 1",
+};
+#define CORPUS_SIZE ((int) (sizeof(CORPUS) / sizeof(CORPUS[0])))
+
+static const char *PIECE_NAMES[] = {"", "pawn", "knight", "bishop", "rook", "queen", "king"};
+
+typedef struct {
+    int board;
+    V2Int from, to;
+} BenchMove;
+
+typedef struct {
+    char name[NAME_LEN];
+    long (*run)(int arg);           // Runs one batch, returning the number of calls.
+    void (*setup)(void);            // Untimed, before each batch.
+    void (*teardown)(void);         // Untimed, after each batch.
+    int arg;
+} Benchmark;
+
+typedef struct {
+    char name[NAME_LEN];
+    long calls;
+    double median, p99;
+} BenchResult;
+
+static Board boards[CORPUS_SIZE];
+static Board scratch;
+static Board copies[MAX_MOVES];
+static BenchMove legal[MAX_MOVES], pseudo[MAX_MOVES];
+static int num_legal = 0, num_pseudo = 0;
+static PositionBatch batch;
+// Results of `bench_one_at_a_time`, kept like the batch's.
+static Bitboard one_attacks[CORPUS_SIZE][2];
+static unsigned short one_mobility[CORPUS_SIZE];
+static bool one_check[CORPUS_SIZE];
+// The corpus again, with accumulators, when a network is given with -e.
+static Board nnue_boards[CORPUS_SIZE];
+static bool have_network = false;
+
+
+static long bench_process_FEN(int arg)
+{
+    (void) arg;
+    for (int i = 0; i < CORPUS_SIZE; i++)
+        process_FEN(&scratch, CORPUS[i]);
+    return CORPUS_SIZE;
+}
+
+
+static long bench_get_valid_moves(int type)
+{
+    // Every piece of the given type, of both colors.
+
+    long calls = 0;
+    for (int b = 0; b < CORPUS_SIZE; b++) {
+        for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+            if ((*(boards[b].arr + i) & PIECE_BITMASK) != type)
+                continue;
+            Bitboard moves = (Bitboard) 0;
+            get_valid_moves((V2Int) {i % BOARD_DIM, i / BOARD_DIM}, &moves, boards + b, true);
+            calls++;
+        }
+    }
+    return calls;
+}
+
+
+static long bench_verify_move(int arg)
+{
+    // Every move that is legal apart from checks.
+
+    (void) arg;
+    for (int i = 0; i < num_pseudo; i++)
+        verify_move(pseudo[i].from, pseudo[i].to, boards + pseudo[i].board, true);
+    return num_pseudo;
+}
+
+
+static long bench_in_check(int arg)
+{
+    (void) arg;
+    for (int b = 0; b < CORPUS_SIZE; b++)
+        in_check(boards + b);
+    return CORPUS_SIZE;
+}
+
+
+static long bench_attacked_positions(int arg)
+{
+    // Squares attacked by all of the side to move's pieces.
+
+    (void) arg;
+    for (int b = 0; b < CORPUS_SIZE; b++)
+        attacked_positions(boards[b].turn, boards + b, false);
+    return CORPUS_SIZE;
+}
+
+
+static long bench_one_at_a_time(int arg)
+{
+    // What the batch kernels replace: both colors' attacks, the side to
+    // move's mobility and its check status, found a position at a time
+    // from the attacks of each piece.
+
+    (void) arg;
+    for (int b = 0; b < CORPUS_SIZE; b++) {
+        Board *board = boards + b;
+        Bitboard own[2] = {0, 0};
+        for (int pos = 0; pos < BOARD_DIM * BOARD_DIM; pos++) {
+            if (board->arr[pos] != 0)
+                own[COLOR_INDEX(board->arr[pos] & COLOR_BITMASK)] |= (Bitboard) 1 << pos;
+        }
+
+        Bitboard *attacks = one_attacks[b], king = 0;
+        attacks[0] = attacks[1] = 0;
+        one_mobility[b] = 0;
+        for (int pos = 0; pos < BOARD_DIM * BOARD_DIM; pos++) {
+            Piece p = board->arr[pos];
+            if (p == 0)
+                continue;
+            int c = COLOR_INDEX(p & COLOR_BITMASK);
+            Bitboard piece = piece_attacks(pos, board);
+            attacks[c] |= piece;
+            if ((p & COLOR_BITMASK) != board->turn)
+                continue;
+            if ((p & PIECE_BITMASK) == KING)
+                king = (Bitboard) 1 << pos;
+            if ((p & PIECE_BITMASK) != PAWN)
+                one_mobility[b] += __builtin_popcountl(piece & ~own[c]);
+        }
+        one_check[b] = (attacks[!COLOR_INDEX(board->turn)] & king) != 0;
+    }
+    return CORPUS_SIZE;
+}
+
+
+static long bench_batch(int kernel)
+{
+    compute_batch(&batch, kernel);
+    return batch.count;
+}
+
+
+static long bench_evaluate(int arg)
+{
+    (void) arg;
+    for (int b = 0; b < CORPUS_SIZE; b++)
+        evaluate(boards + b);
+    return CORPUS_SIZE;
+}
+
+
+static long bench_nnue_evaluate(int kernel)
+{
+    for (int b = 0; b < CORPUS_SIZE; b++)
+        nnue_evaluate(nnue_boards + b, kernel);
+    return CORPUS_SIZE;
+}
+
+
+static void setup_copies(void)
+{
+    for (int i = 0; i < num_legal; i++)
+        copy_board(copies + i, boards + legal[i].board);
+}
+
+
+static void setup_nnue_copies(void)
+{
+    for (int i = 0; i < num_legal; i++)
+        copy_board(copies + i, nnue_boards + legal[i].board);
+}
+
+
+static void free_copies(void)
+{
+    for (int i = 0; i < num_legal; i++)
+        free_board(copies + i);
+}
+
+
+static long bench_make_move(int arg)
+{
+    // Every legal move, each on its own copy of the position.
+
+    (void) arg;
+    for (int i = 0; i < num_legal; i++)
+        make_move(legal[i].from, legal[i].to, copies + i);
+    return num_legal;
+}
+
+
+static long bench_copy_board(int arg)
+{
+    // One copy per legal move, like a copy-make search would make.
+
+    (void) arg;
+    for (int i = 0; i < num_legal; i++)
+        copy_board(copies + i, boards + legal[i].board);
+    return num_legal;
+}
+
+
+static void init_corpus(void)
+{
+    // Sets up the positions and lists their moves.
+
+    create_board(&scratch, CORPUS[0]);
+    for (int b = 0; b < CORPUS_SIZE; b++) {
+        create_board(boards + b, CORPUS[b]);
+        for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+            if ((*(boards[b].arr + i) & COLOR_BITMASK) != boards[b].turn)
+                continue;
+            V2Int from = {i % BOARD_DIM, i / BOARD_DIM};
+            Bitboard moves = (Bitboard) 0;
+            get_valid_moves(from, &moves, boards + b, false);
+            for (; moves && num_pseudo < MAX_MOVES; moves &= moves - 1) {
+                int j = __builtin_ctzl(moves);
+                pseudo[num_pseudo++] = (BenchMove) {b, from, {j % BOARD_DIM, j / BOARD_DIM}};
+            }
+            moves = *(boards[b].legal_moves + i);
+            for (; moves && num_legal < MAX_MOVES; moves &= moves - 1) {
+                int j = __builtin_ctzl(moves);
+                legal[num_legal++] = (BenchMove) {b, from, {j % BOARD_DIM, j / BOARD_DIM}};
+            }
+        }
+    }
+
+    init_batch(&batch, CORPUS_SIZE * BATCH_COPIES);
+    for (int i = 0; i < BATCH_COPIES; i++) {
+        for (int b = 0; b < CORPUS_SIZE; b++)
+            add_to_batch(&batch, boards + b);
+    }
+}
+
+
+static int init_benchmarks(Benchmark *benchmarks)
+{
+    // Lists every benchmark, in the order they are reported.
+
+    int n = 0;
+    benchmarks[n++] = (Benchmark) {"process_FEN", bench_process_FEN, NULL, NULL, 0};
+    for (int type = PAWN; type <= KING; type++) {
+        benchmarks[n] = (Benchmark) {"", bench_get_valid_moves, NULL, NULL, type};
+        snprintf(benchmarks[n++].name, NAME_LEN, "get_valid_moves/%s", PIECE_NAMES[type]);
+    }
+    benchmarks[n++] = (Benchmark) {"verify_move", bench_verify_move, NULL, NULL, 0};
+    benchmarks[n++] = (Benchmark) {"in_check", bench_in_check, NULL, NULL, 0};
+    benchmarks[n++] = (Benchmark) {"attacked_positions", bench_attacked_positions, NULL, NULL, 0};
+    benchmarks[n++] = (Benchmark) {"make_move", bench_make_move, setup_copies, free_copies, 0};
+    benchmarks[n++] = (Benchmark) {"copy_board", bench_copy_board, NULL, free_copies, 0};
+    benchmarks[n++] = (Benchmark) {"batch/one_at_a_time", bench_one_at_a_time, NULL, NULL, 0};
+    benchmarks[n++] = (Benchmark) {"batch/scalar", bench_batch, NULL, NULL, BATCH_SCALAR};
+    if (batch_avx2_available())
+        benchmarks[n++] = (Benchmark) {"batch/avx2", bench_batch, NULL, NULL, BATCH_AVX2};
+    benchmarks[n++] = (Benchmark) {"evaluate/classic", bench_evaluate, NULL, NULL, 0};
+    if (have_network) {
+        // The network's kernels, and make_move with the accumulator updates.
+        benchmarks[n++] = (Benchmark) {"evaluate/nnue_scalar", bench_nnue_evaluate, NULL, NULL, NNUE_SCALAR};
+        if (nnue_kernel(NNUE_SSSE3) == NNUE_SSSE3)
+            benchmarks[n++] = (Benchmark) {"evaluate/nnue_ssse3", bench_nnue_evaluate, NULL, NULL, NNUE_SSSE3};
+        if (nnue_kernel(NNUE_AVX2) == NNUE_AVX2)
+            benchmarks[n++] = (Benchmark) {"evaluate/nnue_avx2", bench_nnue_evaluate, NULL, NULL, NNUE_AVX2};
+        benchmarks[n++] = (Benchmark) {"make_move/nnue", bench_make_move, setup_nnue_copies, free_copies, 0};
+    }
+    return n;
+}
+
+
+static double now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+
+static int cmp_doubles(const void *a, const void *b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+static BenchResult run_benchmark(Benchmark *bench, int warmup, int samples)
+{
+    // Times `samples` batches of the benchmark, after `warmup` untimed ones.
+
+    static double times[MAX_SAMPLES];
+    BenchResult result;
+    strcpy(result.name, bench->name);
+
+    // Batches that can simply be repeated run enough times to be measurable.
+    int repeat = 1;
+    if (bench->setup == NULL && bench->teardown == NULL) {
+        double start = now_ns();
+        bench->run(bench->arg);
+        double elapsed = now_ns() - start;
+        if (elapsed < MIN_BATCH_NS)
+            repeat = MIN_BATCH_NS / (elapsed > 1 ? elapsed : 1) + 1;
+    }
+
+    for (int s = -warmup; s < samples; s++) {
+        if (bench->setup != NULL)
+            bench->setup();
+        long calls = 0;
+        double start = now_ns();
+        for (int r = 0; r < repeat; r++)
+            calls += bench->run(bench->arg);
+        double elapsed = now_ns() - start;
+        if (bench->teardown != NULL)
+            bench->teardown();
+
+        result.calls = calls / repeat;
+        if (s >= 0)
+            times[s] = calls ? elapsed / calls : 0;
+    }
+
+    qsort(times, samples, sizeof(double), cmp_doubles);
+    result.median = times[samples / 2];
+    result.p99 = times[(samples * 99) / 100 < samples ? (samples * 99) / 100 : samples - 1];
+    return result;
+}
+
+
+static int load_baseline(char *path, BenchResult *baseline)
+{
+    // Reads results saved with -s. Returns how many there are, or -1 if the
+    // file can't be read.
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    int n = 0;
+    while (n < MAX_BENCHMARKS && fscanf(fp, "%31s %ld %lf %lf", baseline[n].name, &baseline[n].calls,
+                &baseline[n].median, &baseline[n].p99) == 4)
+        n++;
+    fclose(fp);
+    return n;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Runs the benchmarks, e.g.
+    //   ./benchmark -s before.txt
+    //   ./benchmark -c before.txt
+
+    int samples = 200, warmup = 20;
+    double threshold = 5.0;
+    char *filter = NULL, *save_path = NULL, *compare_path = NULL;
+    int opt;
+    char *network_path = NULL;
+    while ((opt = getopt(argc, argv, "n:w:f:s:c:t:e:")) != -1) {
+        if (opt == 'n')
+            samples = atoi(optarg);
+        else if (opt == 'w')
+            warmup = atoi(optarg);
+        else if (opt == 'f')
+            filter = optarg;
+        else if (opt == 's')
+            save_path = optarg;
+        else if (opt == 'c')
+            compare_path = optarg;
+        else if (opt == 't')
+            threshold = atof(optarg);
+        else if (opt == 'e')
+            network_path = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-n samples] [-w warmup] [-f filter] [-s save.txt] [-c baseline.txt] [-t percent]\n", argv[0]);
+            fprintf(stderr, "          [-e net.nnue]\n");
+            return 1;
+        }
+    }
+    if (samples < 1) samples = 1;
+    if (samples > MAX_SAMPLES) samples = MAX_SAMPLES;
+    if (warmup < 0) warmup = 0;
+
+    BenchResult baseline[MAX_BENCHMARKS];
+    int num_baseline = 0;
+    if (compare_path != NULL && (num_baseline = load_baseline(compare_path, baseline)) < 0) {
+        perror(compare_path);
+        return 1;
+    }
+
+    init_corpus();
+    if (network_path != NULL) {
+        if (!load_network(network_path)) {
+            fprintf(stderr, "Could not load network %s\n", network_path);
+            return 1;
+        }
+        have_network = true;
+        for (int b = 0; b < CORPUS_SIZE; b++)
+            create_board(nnue_boards + b, CORPUS[b]);
+    }
+    Benchmark benchmarks[MAX_BENCHMARKS];
+    int num_benchmarks = init_benchmarks(benchmarks);
+    BenchResult results[MAX_BENCHMARKS];
+    int num_results = 0;
+
+    printf("%-24s %8s %12s %12s", "benchmark", "calls", "median ns", "p99 ns");
+    if (compare_path != NULL)
+        printf(" %12s %9s", "base median", "change");
+    printf("\n");
+
+    int regressions = 0;
+    for (int i = 0; i < num_benchmarks; i++) {
+        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+            continue;
+        BenchResult *result = results + num_results++;
+        *result = run_benchmark(benchmarks + i, warmup, samples);
+        printf("%-24s %8ld %12.1f %12.1f", result->name, result->calls, result->median, result->p99);
+
+        for (int j = 0; j < num_baseline; j++) {
+            if (strcmp(baseline[j].name, result->name) != 0)
+                continue;
+            double change = 100.0 * (result->median - baseline[j].median) / baseline[j].median;
+            bool slower = change > threshold;
+            regressions += slower;
+            printf(" %12.1f %+8.1f%%%s", baseline[j].median, change, slower ? "  slower" : "");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    // Throughput of the batch kernels, as positions per second.
+    double rates[3] = {0, 0, 0};
+    const char *kernels[3] = {"batch/one_at_a_time", "batch/scalar", "batch/avx2"};
+    for (int i = 0; i < num_results; i++) {
+        for (int k = 0; k < 3; k++) {
+            if (strcmp(results[i].name, kernels[k]) == 0 && results[i].median > 0)
+                rates[k] = 1e9 / results[i].median;
+        }
+    }
+    if (rates[1] > 0) {
+        printf("\nbatch attacks: %.0f positions/s one at a time, %.0f scalar", rates[0], rates[1]);
+        if (rates[2] > 0)
+            printf(", %.0f avx2 (%.1fx scalar)", rates[2], rates[2] / rates[1]);
+        printf("\n");
+    }
+
+    if (save_path != NULL) {
+        FILE *fp = fopen(save_path, "w");
+        if (fp == NULL) {
+            perror(save_path);
+            return 1;
+        }
+        for (int i = 0; i < num_results; i++)
+            fprintf(fp, "%s %ld %.1f %.1f\n", results[i].name, results[i].calls, results[i].median, results[i].p99);
+        fclose(fp);
+    }
+
+    for (int b = 0; b < CORPUS_SIZE; b++) {
+        free_board(boards + b);
+        if (have_network)
+            free_board(nnue_boards + b);
+    }
+    free_board(&scratch);
+    free_network();
+    free_batch(&batch);
+
+    // Fail when comparing if anything got slower by more than the threshold.
+    return regressions > 0;
+}
@@ -0,0 +1,169 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * book.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "book.h"
+#include "stats.h"
+
+
+static unsigned long int read_be(const unsigned char *p, int n)
+{
+    // Reads an `n` byte big-endian number.
+
+    unsigned long int x = 0;
+    for (int i = 0; i < n; i++)
+        x = (x << 8) | p[i];
+    return x;
+}
+
+
+bool open_book(Book *book, char *path)
+{
+    // Maps the book at `path` into memory. Pages are only read from disk
+    // when a lookup touches them, so opening a large book is instant.
+
+    book->data = NULL;
+    book->size = 0;
+    book->num_entries = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < BOOK_ENTRY_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    // Lookups jump around the file, so read-ahead would only waste memory.
+    madvise(data, st.st_size, MADV_RANDOM);
+
+    book->data = data;
+    book->size = st.st_size;
+    book->num_entries = st.st_size / BOOK_ENTRY_SIZE;
+    return true;
+}
+
+
+void close_book(Book *book)
+{
+    // Unmaps the book.
+
+    if (book->data != NULL)
+        munmap((void*) book->data, book->size);
+    book->data = NULL;
+    book->size = 0;
+    book->num_entries = 0;
+}
+
+
+static bool decode_move(unsigned int move, Board *board, V2Int *from, V2Int *to)
+{
+    // Converts a Polyglot move into board coordinates. Returns false if the
+    // move can't be played on this board.
+
+    // Polyglot rows count up from rank 1, the board's rows count down from rank 8.
+    from->x = (move >> 6) & 7;
+    from->y = BOARD_DIM - 1 - ((move >> 9) & 7);
+    to->x = move & 7;
+    to->y = BOARD_DIM - 1 - ((move >> 3) & 7);
+
+    // `make_move` always promotes to a queen, so underpromotions are skipped.
+    int promotion = (move >> 12) & 7;
+    if (promotion != 0 && promotion != 4)
+        return false;
+
+    // Castling is stored as the king capturing its own rook. Convert it to
+    // the square the king lands on.
+    Piece piece = *get_piece(*from, board);
+    Piece target = *get_piece(*to, board);
+    if ((piece & PIECE_BITMASK) == KING && (target & PIECE_BITMASK) == ROOK &&
+            (target & COLOR_BITMASK) == (piece & COLOR_BITMASK))
+        to->x = (to->x == 0) ? 2 : 6;
+
+    // Only accept moves that are legal here; a hash collision or a book made
+    // with different keys could otherwise corrupt the game.
+    if ((piece & COLOR_BITMASK) != board->turn)
+        return false;
+    Bitboard moves = (Bitboard) 0;
+    if (board->legal_moves != NULL)
+        moves = *(board->legal_moves + from->x + BOARD_DIM * from->y);
+    else
+        get_valid_moves(*from, &moves, board, true);
+    return query_bitboard(&moves, to->x + BOARD_DIM * to->y);
+}
+
+
+bool book_move(Book *book, Board *board, V2Int *from, V2Int *to)
+{
+    // Looks the current position up in the book and picks one of its moves
+    // at random, weighted by the entries' weights. Returns false if the
+    // position isn't in the book.
+
+    if (book == NULL || book->data == NULL)
+        return false;
+
+    STAT_INC(STAT_BOOK_PROBE);
+    Key key = hash_board(board);
+
+    // Binary search for the first entry with this key.
+    size_t lo = 0, hi = book->num_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (read_be(book->data + mid * BOOK_ENTRY_SIZE, 8) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    // Entries for the same position are stored next to each other.
+    unsigned long int total = 0;
+    size_t end = lo;
+    while (end < book->num_entries && read_be(book->data + end * BOOK_ENTRY_SIZE, 8) == key) {
+        total += read_be(book->data + end * BOOK_ENTRY_SIZE + 10, 2);
+        end++;
+    }
+    if (end == lo)
+        return false;
+
+    // Pick a weighted entry, then walk forward if it turns out to be unplayable.
+    unsigned long int pick = (total > 0) ? (unsigned long int) rand() % total : 0;
+    size_t chosen = lo;
+    for (size_t i = lo; i < end; i++) {
+        unsigned long int weight = read_be(book->data + i * BOOK_ENTRY_SIZE + 10, 2);
+        if (pick < weight) {
+            chosen = i;
+            break;
+        }
+        pick -= weight;
+    }
+
+    for (size_t i = 0; i < end - lo; i++) {
+        size_t entry = lo + (chosen - lo + i) % (end - lo);
+        unsigned int move = read_be(book->data + entry * BOOK_ENTRY_SIZE + 8, 2);
+        if (decode_move(move, board, from, to)) {
+            STAT_INC(STAT_BOOK_HIT);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,32 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * book.h
+*/
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chessfunc.h"
+
+// Each Polyglot book entry is 16 big-endian bytes: an 8 byte position key,
+// a 2 byte move, a 2 byte weight and 4 bytes of learning data.
+// http://hgm.nubati.net/book_format.html
+#define BOOK_ENTRY_SIZE (16)
+
+// An opening book mapped into memory. Entries are sorted by key, so a
+// lookup is a binary search and nothing is parsed when the book is opened.
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t num_entries;
+} Book;
+
+
+bool open_book(Book *book, char *path);
+void close_book(Book *book);
+bool book_move(Book *book, Board *board, V2Int *from, V2Int *to);
+
+#endif
@@ -12,19 +12,44 @@
 #include "gfx.h"
 
 #include "chessfunc.h"
+#include "hash.h"
+#include "nnue.h"
+#include "stats.h"
 
 
 const char *PIECE_STR = " pnbrqk";
 
+// Positions the knight can move to relative to itself.
+static const V2Int KNIGHT_OFFSETS[] = {
+    {1, 2}, {2, 1}, {-1, 2}, {-2, 1}, {-1, -2}, {-2, -1}, {1, -2}, {2, -1},
+};
+// Positions of all eight neighbor cells relative to current position.
+static const V2Int NEIGHBOR_OFFSETS[] = {
+    {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}, {0, 1},
+};
 
-void create_board(Board *board, char *fen)
+
+bool create_board(Board *board, char *fen)
 {
-    // Creates a board from the specified fen string.
+    // Creates a board from the specified fen string. Returns false if the
+    // string isn't a valid FEN, in which case the board is set up in the
+    // starting position instead.
 
+    STAT_ADD(STAT_ALLOC, 4);
     board->arr = (Piece*) calloc(BOARD_DIM * BOARD_DIM, sizeof(Piece));
     board->highlights = (Bitboard*) calloc(3, sizeof(Bitboard));
-    process_FEN(board, fen);
+    board->legal_moves = (Bitboard*) calloc(BOARD_DIM * BOARD_DIM, sizeof(Bitboard));
+    board->attacks = (AttackMap*) malloc(sizeof(AttackMap));
+    board->accumulator = network_loaded() ? (Accumulator*) aligned_alloc(32, sizeof(Accumulator)) : NULL;
+    bool ok = process_FEN(board, fen);
+    if (!ok)
+        process_FEN(board, START_FEN);
     board->winner = 0;
+    init_attack_map(board);
+    init_board_keys(board);
+    refresh_accumulator(board);
+    update_legal_moves(board);
+    return ok;
 }
 
 
@@ -66,53 +91,72 @@ void display_board(Board *board)
 }
 
 
-void process_FEN(Board *board, char *fen)
+bool process_FEN(Board *board, char *fen)
 {
     // FEN notation is used to store the state of the board in a single string.
     // https://en.wikipedia.org/wiki/Forsyth%E2%80%93Edwards_Notation
-    // This function assumes the FEN string is properly formatted.
+    // The placement, turn, castling and en passant fields are required and
+    // the two move counters may be left off. Returns false, leaving the
+    // board as it was, if the string is malformed or the position has no
+    // king for a side or a pawn on the first or last rank.
 
     static const char *CASTLE_OPTIONS = "qkQK";
 
-    char *tmp_fen = strdup(fen);
-    char placement_str[70], turn[3], castle_str[6], enpassant_str[4];
-    int half_move, full_move;
-
-    strcpy(placement_str, strtok(tmp_fen, " "));
-    strcpy(turn, strtok(NULL, " "));
-    strcpy(castle_str, strtok(NULL, " "));
-    strcpy(enpassant_str, strtok(NULL, " "));
-    half_move = atoi(strtok(NULL, " "));
-    full_move = atoi(strtok(NULL, " "));
-
-    // Pre-compute the rooks to match castling options in FEN string.
-    Piece* rooks = (Piece*) malloc(4 * sizeof(Piece));
-    for (int i = 0; i < 4; i++) {
-        rooks[i] = ROOK;
-        if (!strchr(castle_str, CASTLE_OPTIONS[i]))
-            rooks[i] |= MOVED;
+    if (strlen(fen) >= MAX_FEN_LEN)
+        return false;
+    char tmp_fen[MAX_FEN_LEN];
+    strcpy(tmp_fen, fen);
+
+    // strtok_r keeps its position in `save`, so boards can be set up on
+    // several threads at once.
+    char *fields[6], *save;
+    int num_fields = 0;
+    for (char *tok = strtok_r(tmp_fen, " \t\r\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\r\n", &save)) {
+        if (num_fields == 6)
+            return false;
+        fields[num_fields++] = tok;
+    }
+    if (num_fields < 4)
+        return false;
+    char *placement_ptr = fields[0], *turn = fields[1], *castle_str = fields[2], *enpassant_str = fields[3];
+
+    if (strcmp(turn, "w") != 0 && strcmp(turn, "b") != 0)
+        return false;
+    if (strcmp(castle_str, "-") != 0 && (strlen(castle_str) > 4 || strspn(castle_str, "KQkq") != strlen(castle_str)))
+        return false;
+    if (strcmp(enpassant_str, "-") != 0 && (strlen(enpassant_str) != 2 || enpassant_str[0] < 'a' ||
+            enpassant_str[0] > 'h' || (enpassant_str[1] != '3' && enpassant_str[1] != '6')))
+        return false;
+    int counters[2] = {0, 1};
+    for (int i = 4; i < num_fields; i++) {
+        if (strlen(fields[i]) > 6 || strspn(fields[i], "0123456789") != strlen(fields[i]))
+            return false;
+        counters[i - 4] = atoi(fields[i]);
     }
-    int rook_i = 0;
-
 
-    Piece *arr = board->arr;
-    int file = 0, rank = 0;
-    char *placement_ptr = placement_str;
+    Piece arr[BOARD_DIM * BOARD_DIM];
+    int file = 0, rank = 0, kings[2] = {0, 0};
+    Pos king_pos[2] = {0, 0};
     char curr = *(placement_ptr++);
 
     while (curr != '\0') {
         if (curr == '/') {
             // Go to the next rank if the character is a '/'.
+            if (file != BOARD_DIM || ++rank == BOARD_DIM)
+                return false;
             file = 0;
-            rank++;
-        } else if (isdigit(curr)) {
+        } else if (curr >= '1' && curr <= '8') {
             // Skip `n` spaces if the current character is a number n.
+            if (file + (curr - '0') > BOARD_DIM)
+                return false;
             for (int j = 0; j < (curr - '0'); j++) {
-                *(arr + rank * BOARD_DIM + file) = 0;
+                arr[rank * BOARD_DIM + file] = 0;
                 file++;
             }
         } else {
             // Otherwise, the current character represents a piece.
+            if (file == BOARD_DIM)
+                return false;
             int col = isupper(curr) ? WHITE : BLACK;
             // It's color is represented by the case.
             if (col == WHITE)
@@ -126,19 +170,40 @@ void process_FEN(Board *board, char *fen)
                     break;
                 }
             }
+            if (piece == 0 || (piece == PAWN && (rank == 0 || rank == BOARD_DIM - 1)))
+                return false;
+            if (piece == KING) {
+                kings[COLOR_INDEX(col)]++;
+                king_pos[COLOR_INDEX(col)] = rank * BOARD_DIM + file;
+            }
 
-            // Use the pre-computed rooks
-            if (piece == ROOK && rook_i < 4) 
-                piece = *(rooks + rook_i++);
+            // Only rooks in the corners named by the castling options keep
+            // their right to castle. The options are ordered by corner.
+            if (piece == ROOK) {
+                bool corner = (file == 0 || file == BOARD_DIM - 1) && (rank == 0 || rank == BOARD_DIM - 1);
+                int option = (file == BOARD_DIM - 1) + 2 * (rank == BOARD_DIM - 1);
+                if (!corner || !strchr(castle_str, CASTLE_OPTIONS[option]))
+                    piece |= MOVED;
+            }
+
+            // Pawns off their starting rank can't make a two space move.
+            if (piece == PAWN && rank != ((col == WHITE) ? BOARD_DIM - 2 : 1))
+                piece |= MOVED;
 
             // Set the current piece to the proper value and color using the bitwise or operator.
-            *(arr + rank * BOARD_DIM + file) = piece | col;
+            arr[rank * BOARD_DIM + file] = piece | col;
             file++;
         }
 
         // Increment the fen character pointer.
         curr = *(placement_ptr++);
     }
+    if (rank != BOARD_DIM - 1 || file != BOARD_DIM || kings[0] != 1 || kings[1] != 1)
+        return false;
+
+    memcpy(board->arr, arr, sizeof(arr));
+    board->kings[0] = king_pos[0];
+    board->kings[1] = king_pos[1];
 
     // Set the current player's turn.
     board->turn = (turn[0] == 'w') ? WHITE : BLACK;
@@ -151,8 +216,9 @@ void process_FEN(Board *board, char *fen)
     else
         board->ep_target_pos = convert_coord(enpassant_str); 
 
-    board->half_move_clock = half_move;
-    board->move_count = full_move;
+    board->half_move_clock = counters[0];
+    board->move_count = counters[1];
+    return true;
 }
 
 
@@ -161,15 +227,7 @@ int get_valid_moves(V2Int p_pos, Bitboard *moves, Board *board, bool check_for_c
     // Populates the `moves` pointer with valid positions that the piece at 'p_pos'
     // could move to, and returns the number of moves found.
 
-    // Positions the knight can move to relative to itself.
-    static const V2Int KNIGHT_OFFSETS[] = {
-        {1, 2}, {2, 1}, {-1, 2}, {-2, 1}, {-1, -2}, {-2, -1}, {1, -2}, {2, -1},
-    };
-    // Positions of all eight neighbor cells relative to current position.
-    static const V2Int NEIGHBOR_OFFSETS[] = {
-        {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}, {0, 1},
-    };
-
+    STAT_TIME(STAT_GET_VALID_MOVES);
     int i = 0;
 
     Piece *p_ptr = get_piece(p_pos, board);
@@ -297,8 +355,10 @@ int get_valid_moves(V2Int p_pos, Bitboard *moves, Board *board, bool check_for_c
 
             if (p_moved || !check_for_check) break;
             // Check for castling availibility.
-            Bitboard attacked = attacked_positions((p_col == WHITE) ? BLACK : WHITE, board, false);
+            Bitboard attacked = board->attacks->color[COLOR_INDEX((p_col == WHITE) ? BLACK : WHITE)];
             int king_file = (p_col == WHITE) ? 7 : 0;
+            // A king in check can't castle.
+            if (query_bitboard(&attacked, p_pos.x + BOARD_DIM * p_pos.y)) break;
 
             // First check queen-side castle.
             Pos rook_pos = 0 + BOARD_DIM * king_file;
@@ -312,14 +372,15 @@ int get_valid_moves(V2Int p_pos, Bitboard *moves, Board *board, bool check_for_c
                         availible = false;
                         break;
                     }
-                    // None of these spaces can be controlled by enemy pieces either.
-                    if (query_bitboard(&attacked, rook_pos + i)) {
+                    // None of the spaces the king crosses can be controlled by
+                    // enemy pieces either.
+                    if (i > 1 && query_bitboard(&attacked, rook_pos + i)) {
                         availible = false;
                         break;
                     }
                 }
                 if (availible) {
-                    update_bitboard(moves, rook_pos + 1);
+                    update_bitboard(moves, rook_pos + 2);
                     i++;
                 }
             }
@@ -369,6 +430,7 @@ bool verify_move(V2Int pos, V2Int new_pos, Board *board, bool check_for_check)
 {
     // Check to see if moving the piece at `pos` to `new_pos` is valid.
 
+    STAT_TIME(STAT_VERIFY_MOVE);
     Piece *arr = board->arr;
     Piece *p = get_piece(pos, board);
     Piece *target = get_piece(new_pos, board);
@@ -381,18 +443,11 @@ bool verify_move(V2Int pos, V2Int new_pos, Board *board, bool check_for_check)
     if (!check_for_check) return 1;
     // If check_for_check is set, the code below checks if this move
     // would put the current player in check. If so, the move is invalid.
-    Board *new_board = (Board*) malloc(sizeof(Board));
-    copy_board(new_board, board);
+    BoardCopy copy;
+    Board *new_board = copy_board_local(&copy, board);
     make_move(pos, new_pos, new_board);
 
-    if (in_check(new_board) & p_col) {
-        free_board(new_board);
-        return 0;
-    }
-
-    free_board(new_board);
-
-    return 1;
+    return !(in_check(new_board) & p_col);
 }
 
 
@@ -401,37 +456,35 @@ short int in_check(Board *board)
     // Returns an integer telling if each color is in check or not.
     // Returns 0 if neither player in in check.
 
-    Piece *curr = board->arr;
-    // Locate the two kings on the board.
-    Pos king_w, king_b;
-    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
-        if ((*curr & PIECE_BITMASK) == KING) { 
-            if ((*curr & COLOR_BITMASK) == WHITE)
-                king_w = i;
-            else
-                king_b = i;
-        }
-        curr++;
-    }
+    STAT_TIME(STAT_IN_CHECK);
+    Pos king_w = board->kings[COLOR_INDEX(WHITE)], king_b = board->kings[COLOR_INDEX(BLACK)];
 
+    // The attack map already knows every square each color attacks.
     short int in_check = 0;
-    Bitboard attacked = attacked_positions(BLACK, board, false);
-    if (query_bitboard(&attacked, king_w))
+    if (query_bitboard(board->attacks->color + COLOR_INDEX(BLACK), king_w))
         in_check |= WHITE;
     
-    attacked = attacked_positions(WHITE, board, false);
-    if (query_bitboard(&attacked, king_b))
+    if (query_bitboard(board->attacks->color + COLOR_INDEX(WHITE), king_b))
         in_check |= BLACK;
 
     return in_check;
 }
 
 
+bool can_castle(Pos king_pos, Pos rook_pos, int col, Board *board)
+{
+    // A side keeps a castling right while its king and that rook are unmoved.
+
+    return *(board->arr + king_pos) == (KING | col) && *(board->arr + rook_pos) == (ROOK | col);
+}
+
+
 Bitboard attacked_positions(PieceType bitmask, Board *board, bool check_for_check)
 {
     // Retuens a bitboard indicating which positions are attacked
     // by the specified piece type.
 
+    STAT_TIME(STAT_ATTACKED_POSITIONS);
     Bitboard attacked = 0;
     Piece *curr = board->arr;
     for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++, curr++) {
@@ -450,19 +503,56 @@ Bitboard attacked_positions(PieceType bitmask, Board *board, bool check_for_chec
 }
 
 
-void copy_board(Board *dest, Board *board)
+static void copy_position(Board *dest, Board *board)
 {
-    // Make a copy of the board and store it in `new_board`.
+    // Copies everything but the storage, which `dest` already points to.
 
-    dest->arr = (Piece*) malloc(BOARD_DIM * BOARD_DIM * sizeof(Piece));
     memcpy(dest->arr, board->arr, BOARD_DIM * BOARD_DIM * sizeof(Piece));
     dest->turn = board->turn;
     dest->winner = board->winner;
     dest->ep_target_pos = board->ep_target_pos;
     dest->half_move_clock = board->half_move_clock;
     dest->move_count = board->move_count;
-    // Highlights aren't used for copied boards.
+    dest->pawn_key = board->pawn_key;
+    dest->material_key = board->material_key;
+    dest->kings[0] = board->kings[0];
+    dest->kings[1] = board->kings[1];
+    // Highlights and the legal move cache aren't used for copied boards.
     dest->highlights = NULL;
+    dest->legal_moves = NULL;
+    dest->num_legal_moves = 0;
+    // The attack map and accumulators are copied so the new board can keep
+    // them up to date.
+    memcpy(dest->attacks, board->attacks, sizeof(AttackMap));
+    if (board->accumulator != NULL)
+        memcpy(dest->accumulator, board->accumulator, sizeof(Accumulator));
+}
+
+
+void copy_board(Board *dest, Board *board)
+{
+    // Make a copy of the board and store it in `new_board`.
+
+    STAT_TIME(STAT_COPY_BOARD);
+    STAT_ADD(STAT_ALLOC, 2);
+    dest->arr = (Piece*) malloc(BOARD_DIM * BOARD_DIM * sizeof(Piece));
+    dest->attacks = (AttackMap*) malloc(sizeof(AttackMap));
+    dest->accumulator = (board->accumulator != NULL) ? (Accumulator*) aligned_alloc(32, sizeof(Accumulator)) : NULL;
+    copy_position(dest, board);
+}
+
+
+Board* copy_board_local(BoardCopy *copy, Board *board)
+{
+    // Copies the board into `copy` without allocating any memory and
+    // returns the copy.
+
+    STAT_TIME(STAT_COPY_BOARD);
+    copy->board.arr = copy->arr;
+    copy->board.attacks = &copy->attacks;
+    copy->board.accumulator = (board->accumulator != NULL) ? &copy->accumulator : NULL;
+    copy_position(&copy->board, board);
+    return &copy->board;
 }
 
 
@@ -472,37 +562,59 @@ void free_board(Board *board)
 
     free(board->arr);
     free(board->highlights);
+    free(board->legal_moves);
+    free(board->attacks);
+    free(board->accumulator);
 }
 
 
 void make_move(V2Int pos, V2Int target, Board *board)
 {
-    // Moves the piece at `pos` to `target`.
+    // Moves the piece at `pos` to `target`. Pawns reaching the last rank
+    // become queens.
+
+    make_promotion(pos, target, QUEEN, board);
+}
 
+
+void make_promotion(V2Int pos, V2Int target, PieceType promotion, Board *board)
+{
+    // Moves the piece at `pos` to `target`, turning a pawn that reaches the
+    // last rank into a `promotion`.
+
+    STAT_TIME(STAT_MAKE_MOVE);
     Piece *piece = get_piece(pos, board);
     Piece *target_piece = get_piece(target, board);
     
     short int p_type = *piece & PIECE_BITMASK;
-    if (*target_piece != 0 || p_type == PAWN) 
-        board->half_move_clock = 0;
+    // The keys and accumulators are updated from the squares that changed.
+    Piece before[BOARD_DIM * BOARD_DIM];
+    memcpy(before, board->arr, BOARD_DIM * BOARD_DIM * sizeof(Piece));
+    // Captures and pawn moves restart the count towards the 50 move rule.
+    bool reset_clock = *target_piece != 0 || p_type == PAWN;
+
+    // Keep track of every square whose contents change for the attack map.
+    Bitboard changed = (Bitboard) 0;
+    update_bitboard(&changed, pos.x + BOARD_DIM * pos.y);
+    update_bitboard(&changed, target.x + BOARD_DIM * target.y);
 
     // Check for en passant.
     if (p_type == PAWN && (target.x + BOARD_DIM * target.y) == board->ep_target_pos) {
         V2Int dir = {0, (*piece & COLOR_BITMASK) == WHITE ? 1 : -1};
-        *get_piece(add_V2Int(target, dir), board) = 0;
+        V2Int captured = add_V2Int(target, dir);
+        *get_piece(captured, board) = 0;
+        update_bitboard(&changed, captured.x + BOARD_DIM * captured.y);
     }
 
     if (p_type == KING && abs(sub_V2Int(pos, target).x) >= 2) {
-        // If the user is castling, swap the two pieces on either side of the king;
+        // If the user is castling, move the rook to the other side of the king.
         Pos target_pos = target.x + BOARD_DIM * target.y;
-        Piece tmp = *(board->arr + target_pos + 1);
-        *(board->arr + target_pos + 1) = *(board->arr + target_pos - 1);
-        *(board->arr + target_pos - 1) = tmp;
-
-        if (*(board->arr + target_pos + 1) != 0)
-            *(board->arr + target_pos + 1) |= MOVED;
-        if (*(board->arr + target_pos - 1) != 0)
-            *(board->arr + target_pos - 1) |= MOVED;
+        Pos rook_pos = (target.x > pos.x) ? target_pos + 1 : target_pos - 2;
+        Pos rook_target = (target.x > pos.x) ? target_pos - 1 : target_pos + 1;
+        update_bitboard(&changed, rook_pos);
+        update_bitboard(&changed, rook_target);
+        *(board->arr + rook_target) = *(board->arr + rook_pos) | MOVED;
+        *(board->arr + rook_pos) = 0;
     }
 
 
@@ -511,14 +623,44 @@ void make_move(V2Int pos, V2Int target, Board *board)
     else
         board->ep_target_pos = 64;
 
+    if (p_type == KING)
+        board->kings[COLOR_INDEX(*piece & COLOR_BITMASK)] = target.x + BOARD_DIM * target.y;
+
     // Also mark the moving piece as moved.
     *target_piece = (*piece) | MOVED;
     *piece = 0;
+
+    if (p_type == PAWN && (target.y == 0 || target.y == BOARD_DIM - 1))
+        *target_piece = promotion | (*target_piece & COLOR_BITMASK) | MOVED;
     
     if (board->turn == BLACK) (board->move_count)++;
-    board->half_move_clock++;
+    board->half_move_clock = reset_clock ? 0 : board->half_move_clock + 1;
     board->turn = (board->turn == WHITE) ? BLACK : WHITE;
 
+    if (board->attacks != NULL)
+        update_attack_map(changed, board);
+    for (Bitboard b = changed; b; b &= b - 1) {
+        int sq = __builtin_ctzl(b);
+        Piece old = before[sq], new = *(board->arr + sq);
+        if ((old & ~MOVED) == (new & ~MOVED))
+            continue;
+        if (old != 0) {
+            board->material_key -= 1UL << MATERIAL_SHIFT(old);
+            if ((old & PIECE_BITMASK) == PAWN)
+                board->pawn_key ^= zobrist_piece(old, sq);
+        }
+        if (new != 0) {
+            board->material_key += 1UL << MATERIAL_SHIFT(new);
+            if ((new & PIECE_BITMASK) == PAWN)
+                board->pawn_key ^= zobrist_piece(new, sq);
+        }
+        if (board->accumulator != NULL)
+            update_accumulator(board, sq, old, new);
+    }
+
+    // Boards that own a legal move cache refresh it for the new position.
+    if (board->legal_moves != NULL)
+        update_legal_moves(board);
 }
 
 
@@ -720,3 +862,249 @@ int total_moves(Board *board, int ply)
 
 
 }
+
+
+void update_legal_moves(Board *board)
+{
+    // Generates every legal move for the current player once and stores
+    // them by starting square, so clicks and game-over tests are lookups.
+
+    STAT_TIME(STAT_LEGAL_UPDATE);
+    board->num_legal_moves = 0;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        Bitboard *moves = board->legal_moves + i;
+        *moves = (Bitboard) 0;
+        if ((*(board->arr + i) & COLOR_BITMASK) != board->turn)
+            continue;
+        V2Int tmp = {i % BOARD_DIM, i / BOARD_DIM};
+        get_valid_moves(tmp, moves, board, true);
+        board->num_legal_moves += __builtin_popcountl(*moves);
+    }
+}
+
+
+bool has_legal_move(Board *board)
+{
+    // Returns true if the current player has at least one legal move.
+
+    if (board->legal_moves != NULL)
+        return board->num_legal_moves > 0;
+
+    // Without a cache, stop at the first piece that can move.
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if ((*(board->arr + i) & COLOR_BITMASK) != board->turn)
+            continue;
+        Bitboard moves = (Bitboard) 0;
+        V2Int tmp = {i % BOARD_DIM, i / BOARD_DIM};
+        get_valid_moves(tmp, &moves, board, true);
+        if (moves != (Bitboard) 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+bool random_legal_move(Board *board, unsigned int *seed, Move *move)
+{
+    // Picks one of the legal moves uniformly at random, promoting to a
+    // queen. Returns false if there are none.
+
+    if (board->num_legal_moves == 0)
+        return false;
+
+    int pick = rand_r(seed) % board->num_legal_moves;
+    for (int sq = 0; sq < BOARD_DIM * BOARD_DIM; sq++) {
+        Bitboard moves = *(board->legal_moves + sq);
+        int n = __builtin_popcountl(moves);
+        if (pick >= n) {
+            pick -= n;
+            continue;
+        }
+        for (; pick > 0; pick--)
+            moves &= moves - 1;
+        *move = (Move) {sq, __builtin_ctzl(moves), QUEEN};
+        return true;
+    }
+    return false;
+}
+
+
+void update_winner(Board *board)
+{
+    // Tests to see if the game is over after a move and sets `winner`.
+
+    if (!has_legal_move(board)) {
+        // Current player in has no valid moves.
+        if (in_check(board) & board->turn) // Checkmate.
+            board->winner = (board->turn == WHITE) ? BLACK : WHITE;
+        else // Stalemate.
+            board->winner = COLOR_BITMASK;
+    }
+
+    // 50 moves by each player without a capture or pawn move is a draw,
+    // as is a position where neither side has the pieces to mate.
+    if (!board->winner && (board->half_move_clock >= FIFTY_MOVE_PLIES || insufficient_material(board)))
+        board->winner = COLOR_BITMASK;
+}
+
+
+bool insufficient_material(Board *board)
+{
+    // Returns true if neither player can possibly checkmate: bare kings,
+    // a single knight or bishop, or only bishops all on one square color.
+
+    int minors = 0, knights = 0;
+    int bishop_colors = 0;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        int type = *(board->arr + i) & PIECE_BITMASK;
+        if (type == PAWN || type == ROOK || type == QUEEN)
+            return false;
+        if (type == KNIGHT) {
+            minors++;
+            knights++;
+        } else if (type == BISHOP) {
+            minors++;
+            bishop_colors |= 1 << ((i % BOARD_DIM + i / BOARD_DIM) % 2);
+        }
+    }
+
+    return minors <= 1 || (knights == 0 && bishop_colors != 3);
+}
+
+
+Bitboard piece_attacks(Pos pos, Board *board)
+{
+    // Returns a bitboard of the squares attacked by the piece at `pos`.
+    // Unlike `get_valid_moves`, pawns only attack diagonally and squares
+    // occupied by friendly pieces count as attacked (defended).
+
+    V2Int p_pos = {pos % BOARD_DIM, pos / BOARD_DIM};
+    Piece p = *(board->arr + pos);
+    int p_type = p & PIECE_BITMASK;
+    int dir = (p & COLOR_BITMASK) == WHITE ? -1 : 1;
+
+    Bitboard attacks = (Bitboard) 0;
+    V2Int new_pos;
+    Piece *target;
+    switch (p_type) {
+        case PAWN:
+            for (int j = -1; j <= 1; j += 2) {
+                new_pos = add_V2Int(p_pos, (V2Int) {j, dir});
+                if (get_piece(new_pos, board) != NULL)
+                    update_bitboard(&attacks, new_pos.x + BOARD_DIM * new_pos.y);
+            }
+            break;
+        case KNIGHT:
+            for (int j = 0; j < 8; j++) {
+                new_pos = add_V2Int(p_pos, KNIGHT_OFFSETS[j]);
+                if (get_piece(new_pos, board) != NULL)
+                    update_bitboard(&attacks, new_pos.x + BOARD_DIM * new_pos.y);
+            }
+            break;
+        case BISHOP:
+        case ROOK:
+        case QUEEN:
+            // Bishops use the even (diagonal) offsets, rooks the odd ones, and
+            // queens all of them. Each ray stops at the first occupied square.
+            for (int j = (p_type == ROOK); j < 8; j += (p_type == QUEEN) ? 1 : 2) {
+                new_pos = p_pos;
+                while ((target = get_piece(new_pos = add_V2Int(new_pos, NEIGHBOR_OFFSETS[j]), board)) != NULL) {
+                    update_bitboard(&attacks, new_pos.x + BOARD_DIM * new_pos.y);
+                    if (*target != 0) break;
+                }
+            }
+            break;
+        case KING:
+            for (int j = 0; j < 8; j++) {
+                new_pos = add_V2Int(p_pos, NEIGHBOR_OFFSETS[j]);
+                if (get_piece(new_pos, board) != NULL)
+                    update_bitboard(&attacks, new_pos.x + BOARD_DIM * new_pos.y);
+            }
+            break;
+    }
+
+    return attacks;
+}
+
+
+static void add_piece_attacks(int pos, Board *board)
+{
+    // Stores the attacks of the piece at `pos` and adds them to its
+    // color's attack counts.
+
+    AttackMap *map = board->attacks;
+    int col = COLOR_INDEX(*(board->arr + pos) & COLOR_BITMASK);
+    Bitboard attacks = piece_attacks(pos, board);
+
+    map->piece[pos] = attacks;
+    map->owner[pos] = col;
+    map->color[col] |= attacks;
+    for (; attacks; attacks &= attacks - 1)
+        map->count[col][__builtin_ctzl(attacks)]++;
+}
+
+
+static void remove_piece_attacks(int pos, Board *board)
+{
+    // Removes the stored attacks of the piece that was at `pos`, clearing
+    // squares that are no longer attacked by anyone of its color.
+
+    AttackMap *map = board->attacks;
+    int col = map->owner[pos];
+    Bitboard attacks = map->piece[pos];
+
+    for (; attacks; attacks &= attacks - 1) {
+        int sq = __builtin_ctzl(attacks);
+        if (--(map->count[col][sq]) == 0)
+            map->color[col] &= ~((Bitboard) 1 << sq);
+    }
+    map->piece[pos] = (Bitboard) 0;
+}
+
+
+void init_board_keys(Board *board)
+{
+    // Computes the pawn and material keys of the position from scratch.
+
+    board->pawn_key = 0;
+    board->material_key = 0;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        Piece piece = *(board->arr + i);
+        if (piece == 0)
+            continue;
+        board->material_key += 1UL << MATERIAL_SHIFT(piece);
+        if ((piece & PIECE_BITMASK) == PAWN)
+            board->pawn_key ^= zobrist_piece(piece, i);
+    }
+}
+
+
+void init_attack_map(Board *board)
+{
+    // Builds the attack map for the board from scratch.
+
+    memset(board->attacks, 0, sizeof(AttackMap));
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if (*(board->arr + i) != 0)
+            add_piece_attacks(i, board);
+    }
+}
+
+
+void update_attack_map(Bitboard changed, Board *board)
+{
+    // Updates the attack map after the squares in `changed` were modified.
+    // Only pieces standing on those squares, and pieces whose attacks reach
+    // them (sliders whose lines were opened or blocked), are recomputed.
+
+    STAT_TIME(STAT_ATTACK_UPDATE);
+    AttackMap *map = board->attacks;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if (!query_bitboard(&changed, i) && !(map->piece[i] & changed))
+            continue;
+        remove_piece_attacks(i, board);
+        if (*(board->arr + i) != 0)
+            add_piece_attacks(i, board);
+    }
+}
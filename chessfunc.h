@@ -3,6 +3,9 @@
  * Fund Comp Lab 11
  * chessfunc.h
 */
+#ifndef CHESSFUNC_H
+#define CHESSFUNC_H
+
 #include <stdbool.h>
 
 #define BOARD_DIM (8)
@@ -12,6 +15,20 @@
 #define COLOR_BITMASK (24)   // 4th and 5th bit represent color.
 #define MOVED_BITMASK (32)   // 6th bit tells if the piece has moved.
 
+// Converts a color (WHITE or BLACK) into an index for per-color arrays.
+#define COLOR_INDEX(col) ((col) == WHITE ? 0 : 1)
+
+// Half-moves without a capture or pawn move before the game is drawn.
+#define FIFTY_MOVE_PLIES (100)
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define MAX_FEN_LEN (128)       // Longer strings are never valid FENs.
+
+// The material key packs the number of pieces of each color and type into
+// 4 bits each, so positions with the same material have the same key.
+#define MATERIAL_SHIFT(piece) (4 * (6 * COLOR_INDEX((piece) & COLOR_BITMASK) + ((piece) & PIECE_BITMASK) - 1))
+#define MATERIAL_COUNT(key, col, type) (((key) >> MATERIAL_SHIFT((col) | (type))) & 15)
+
 
 // All of the pieces's data can be stored in a single byte, including it's
 // numerical value, it's color, and whether or not it has moved.
@@ -41,6 +58,13 @@ typedef struct {
 
 typedef char Pos;
 
+// A move from one square to another. `promotion` is the piece type a pawn
+// reaching the last rank becomes.
+typedef struct {
+    Pos from, to;
+    char promotion;
+} Move;
+
 // Taking advantage of the fact that a long int has 64 bits,
 // each bit can represent a boolean value for a square on the board.
 // https://www.chessprogramming.org/Efficient_Generation_of_Sliding_Piece_Attacks
@@ -55,6 +79,28 @@ typedef enum {
 } Highlight;
 
 
+// Squares attacked by each color, kept up to date by `make_move`.
+// Unlike `attacked_positions`, these are true attacks: pawns attack their
+// diagonals only, and pieces defending their own side are included.
+typedef struct {
+    Bitboard color[2];                                  // All squares attacked by each color.
+    Bitboard piece[BOARD_DIM * BOARD_DIM];              // Squares attacked by the piece on each square.
+    char owner[BOARD_DIM * BOARD_DIM];                  // Color index of the piece stored in `piece`.
+    unsigned char count[2][BOARD_DIM * BOARD_DIM];      // Number of attackers of each square.
+} AttackMap;
+
+
+// Sums of the first layer of the evaluation network for each side, kept up
+// to date by `make_move` while a network is loaded. See nnue.h. The vector
+// kernels load them 32 bytes at a time, so ones on the heap come from
+// `aligned_alloc`.
+#define NNUE_HIDDEN (128)
+
+typedef struct {
+    short values[2][NNUE_HIDDEN] __attribute__((aligned(32)));     // Indexed by COLOR_INDEX.
+} Accumulator;
+
+
 // Data structure for a board.
 typedef struct {
     Piece *arr;
@@ -64,20 +110,42 @@ typedef struct {
     int half_move_clock;
     int move_count;
     Bitboard *highlights;
+    // Legal moves for the side to move, indexed by the square they start from.
+    Bitboard *legal_moves;
+    int num_legal_moves;
+    AttackMap *attacks;
+    Accumulator *accumulator;       // NULL unless a network was loaded when the board was made.
+    // Kept up to date by `make_move` for the evaluation's caches.
+    unsigned long int pawn_key;     // Zobrist key of the pawns alone.
+    unsigned long int material_key;
+    Pos kings[2];                   // Square of each side's king, indexed by COLOR_INDEX.
 } Board;
 
+// A copy of a board together with its storage, so short-lived copies in
+// the search and legality checks can live on the stack. The copy made by
+// `copy_board_local` must not be passed to `free_board`.
+typedef struct {
+    Board board;
+    Piece arr[BOARD_DIM * BOARD_DIM];
+    AttackMap attacks;
+    Accumulator accumulator;
+} BoardCopy;
+
 
-void create_board(Board *board, char *fen);
+bool create_board(Board *board, char *fen);
 void display_board(Board *board);
-void process_FEN(Board *board, char *fen);
+bool process_FEN(Board *board, char *fen);
 int get_valid_moves(V2Int p_pos, Bitboard *moves, Board *board, bool check_for_check);
 Piece* get_piece(V2Int pos, Board *board);
 bool verify_move(V2Int pos, V2Int new_pos, Board *board, bool check_for_check);
 short int in_check(Board *board);
+bool can_castle(Pos king_pos, Pos rook_pos, int col, Board *board);
 Bitboard attacked_positions(PieceType type, Board *b, bool check_for_check);
 void copy_board(Board *dest, Board *board);
+Board* copy_board_local(BoardCopy *copy, Board *board);
 void free_board(Board *board);
 void make_move(V2Int pos, V2Int target, Board *board);
+void make_promotion(V2Int pos, V2Int target, PieceType promotion, Board *board);
 V2Int add_V2Int(V2Int a, V2Int b);
 V2Int sub_V2Int(V2Int a, V2Int b);
 int cmp_V2Int(V2Int a, V2Int b);
@@ -90,4 +158,15 @@ void update_bitboard(Bitboard *b, Pos p);
 bool query_bitboard(Bitboard *b, Pos p);
 void print_bitboard(Bitboard *b);
 void end_game(int x, int y, short int winner);
-int total_moves(Board *board, int ply);
\ No newline at end of file
+int total_moves(Board *board, int ply);
+void update_legal_moves(Board *board);
+bool has_legal_move(Board *board);
+bool random_legal_move(Board *board, unsigned int *seed, Move *move);
+void update_winner(Board *board);
+bool insufficient_material(Board *board);
+Bitboard piece_attacks(Pos pos, Board *board);
+void init_attack_map(Board *board);
+void init_board_keys(Board *board);
+void update_attack_map(Bitboard changed, Board *board);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * datagen.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "book.h"
+#include "tablebase.h"
+#include "nnue.h"
+#include "engine.h"
+#include "training.h"
+#include "stats.h"
+
+// Generates training data for evaluation functions. Every thread plays
+// games of the engine against itself from random openings, with some
+// random moves mixed in, and samples positions along the way. Each sample
+// is scored by a shallow search when it is reached; the game's result is
+// filled in once the game ends. Records collect in a buffer per thread and
+// are appended to the output file a few thousand at a time, so the only
+// memory allocated while generating belongs to the boards of new games.
+#define MAX_THREADS (256)
+#define MAX_GAME_PLIES (400)            // Longer games are stopped and counted as draws.
+#define WRITE_BUFFER_RECORDS (4096)
+#define REPORT_INTERVAL (100000)        // Positions between progress reports.
+
+typedef struct {
+    int play_depth, label_depth;
+    int opening_plies;              // Random moves at the start of each game.
+    int random_percent;             // Chance of a random move after the opening.
+    int sample_percent;             // Chance of sampling each position after the opening.
+    long target;                    // Positions to generate.
+    unsigned int seed;
+    FILE *out;
+
+    pthread_mutex_t lock;
+    int next_thread;
+    long positions, games, next_report;
+    bool stop;
+    struct timespec start_time;
+} Generator;
+
+typedef struct {
+    TrainingRecord game[MAX_GAME_PLIES];    // Samples of the current game.
+    TrainingRecord buffer[WRITE_BUFFER_RECORDS];
+    Key history[MAX_GAME_PLIES + 1];
+    int num_buffered;
+} WorkerData;
+
+
+static double elapsed(Generator *gen)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - gen->start_time.tv_sec) + (now.tv_nsec - gen->start_time.tv_nsec) / 1e9;
+}
+
+
+static void flush_records(Generator *gen, WorkerData *data)
+{
+    // Appends the thread's buffered records to the output file, leaving
+    // out any beyond the number asked for.
+
+    pthread_mutex_lock(&gen->lock);
+    long count = data->num_buffered;
+    if (count > gen->target - gen->positions)
+        count = gen->target - gen->positions;
+    fwrite(data->buffer, sizeof(TrainingRecord), count, gen->out);
+    gen->positions += count;
+    if (gen->positions >= gen->target)
+        gen->stop = true;
+    if (gen->positions >= gen->next_report) {
+        double seconds = elapsed(gen);
+        fprintf(stderr, "%ld positions from %ld games in %.1f s, %.0f positions/s, %.2fM positions/hour\n",
+                gen->positions, gen->games, seconds, gen->positions / seconds, gen->positions / seconds * 3600 / 1e6);
+        gen->next_report += REPORT_INTERVAL;
+    }
+    pthread_mutex_unlock(&gen->lock);
+    data->num_buffered = 0;
+}
+
+
+static void play_game(Generator *gen, WorkerData *data, Book *book, unsigned int *seed)
+{
+    // Plays one game, sampling positions into `data->game`, then moves the
+    // samples into the write buffer with the game's result.
+
+    Board board;
+    create_board(&board, START_FEN);
+    int num_samples = 0, num_keys = 0, since = 0;
+    data->history[num_keys++] = hash_board(&board);
+
+    for (int ply = 0; ply < MAX_GAME_PLIES && !board.winner; ply++) {
+        bool opening = ply < gen->opening_plies;
+        // Positions in check are left out: their score depends on the
+        // forced reply more than on the position.
+        if (!opening && rand_r(seed) % 100 < gen->sample_percent && !(in_check(&board) & board.turn)) {
+            int score = search(&board, gen->label_depth, -2 * MATE_SCORE, 2 * MATE_SCORE);
+            if (score >= MATE_SCORE - MAX_GAME_PLIES)
+                score = TRAINING_SCORE_MAX;
+            else if (score <= -MATE_SCORE + MAX_GAME_PLIES)
+                score = -TRAINING_SCORE_MAX;
+            pack_record(&board, score, 0, data->game + num_samples++);
+        }
+
+        V2Int from, to;
+        Move move;
+        if ((opening || rand_r(seed) % 100 < gen->random_percent) && random_legal_move(&board, seed, &move)) {
+            from = (V2Int) {move.from % BOARD_DIM, move.from / BOARD_DIM};
+            to = (V2Int) {move.to % BOARD_DIM, move.to / BOARD_DIM};
+        } else {
+            find_move(&board, book, gen->play_depth, &from, &to);
+        }
+        make_move(from, to, &board);
+        update_winner(&board);
+
+        if (board.half_move_clock == 0)
+            since = num_keys;
+        data->history[num_keys++] = hash_board(&board);
+        if (count_repetitions(data->history, num_keys, since) >= 2)
+            board.winner = COLOR_BITMASK;
+    }
+
+    int result = (board.winner == WHITE) ? 1 : (board.winner == BLACK) ? -1 : 0;
+    for (int i = 0; i < num_samples; i++) {
+        data->game[i].result = result;
+        data->buffer[data->num_buffered++] = data->game[i];
+        if (data->num_buffered == WRITE_BUFFER_RECORDS)
+            flush_records(gen, data);
+    }
+
+    pthread_mutex_lock(&gen->lock);
+    gen->games++;
+    pthread_mutex_unlock(&gen->lock);
+    free_board(&board);
+}
+
+
+static void *generate_worker(void *arg)
+{
+    // Plays games until enough positions have been written. Each thread
+    // gets its own random sequence, derived from the seed.
+
+    Generator *gen = (Generator*) arg;
+    pthread_mutex_lock(&gen->lock);
+    unsigned int seed = gen->seed * 7919 + gen->next_thread++;
+    pthread_mutex_unlock(&gen->lock);
+
+    WorkerData *data = (WorkerData*) malloc(sizeof(WorkerData));
+    data->num_buffered = 0;
+    Book book;
+    memset(&book, 0, sizeof(Book));
+
+    while (true) {
+        pthread_mutex_lock(&gen->lock);
+        bool stop = gen->stop;
+        pthread_mutex_unlock(&gen->lock);
+        if (stop)
+            break;
+        play_game(gen, data, &book, &seed);
+    }
+    flush_records(gen, data);
+
+    free(data);
+    flush_stats();
+    return NULL;
+}
+
+
+static int dump_records(char *path, long limit)
+{
+    // Prints the records in a training file as "FEN | score | result".
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    TrainingRecord record;
+    char fen[100];
+    for (long n = 0; (limit < 0 || n < limit) && fread(&record, sizeof(TrainingRecord), 1, fp) == 1; n++) {
+        record_to_FEN(&record, fen);
+        printf("%s | %d | %d\n", fen, record.score, record.result);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-n positions] [-d depth] [-l depth] [-r plies] [-e percent]\n", name);
+    fprintf(stderr, "          [-p percent] [-s seed] [-t tbdir] [--net net.nnue] [--stats] [--stats-json file] out.bin\n");
+    fprintf(stderr, "       %s -x [-n positions] file.bin\n", name);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Appends labelled positions to a training file, e.g.
+    //   ./datagen -j 8 -n 10000000 train.bin
+    // or prints the positions in one with -x.
+
+    enum { OPT_NET = 256 };
+    static const struct option LONG_OPTIONS[] = {
+        {"net", required_argument, NULL, OPT_NET},
+        STAT_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+
+    Generator gen;
+    memset(&gen, 0, sizeof(Generator));
+    gen.play_depth = 2;
+    gen.label_depth = 2;
+    gen.opening_plies = 8;
+    gen.random_percent = 5;
+    gen.sample_percent = 25;
+    gen.target = 1000000;
+    gen.seed = 1;
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool dump = false, limit_set = false;
+    bool show_stats = false;
+    char *stats_json = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:n:d:l:r:e:p:s:t:x", LONG_OPTIONS, NULL)) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'n': gen.target = atol(optarg); limit_set = true; break;
+            case 'd': gen.play_depth = atoi(optarg); break;
+            case 'l': gen.label_depth = atoi(optarg); break;
+            case 'r': gen.opening_plies = atoi(optarg); break;
+            case 'e': gen.random_percent = atoi(optarg); break;
+            case 'p': gen.sample_percent = atoi(optarg); break;
+            case 's': gen.seed = atoi(optarg); break;
+            case 't':
+                if (load_tablebases(optarg) == 0)
+                    fprintf(stderr, "No tablebases found in %s\n", optarg);
+                break;
+            case 'x': dump = true; break;
+            case OPT_NET:
+                if (!load_network(optarg)) {
+                    fprintf(stderr, "Could not load network %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case STAT_OPTION_SUMMARY: show_stats = true; break;
+            case STAT_OPTION_JSON: stats_json = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || gen.play_depth < 1 || gen.label_depth < 0 || gen.target < 1 ||
+            gen.sample_percent < 1 || gen.sample_percent > 100) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (dump)
+        return dump_records(argv[optind], limit_set ? gen.target : -1);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    // New records go after any already in the file.
+    if ((gen.out = fopen(argv[optind], "ab")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    fprintf(stderr, "%ld positions on %d threads, play depth %d, label depth %d, %d random opening plies\n",
+            gen.target, threads, gen.play_depth, gen.label_depth, gen.opening_plies);
+
+    init_zobrist();
+    gen.next_report = REPORT_INTERVAL;
+    clock_gettime(CLOCK_MONOTONIC, &gen.start_time);
+    pthread_mutex_init(&gen.lock, NULL);
+    pthread_t workers[MAX_THREADS];
+    for (int t = 0; t < threads; t++)
+        pthread_create(workers + t, NULL, generate_worker, &gen);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t], NULL);
+    pthread_mutex_destroy(&gen.lock);
+
+    double seconds = elapsed(&gen);
+    fprintf(stderr, "%ld positions from %ld games in %.1f s, %.0f positions/s, %.2fM positions/hour\n",
+            gen.positions, gen.games, seconds, gen.positions / seconds, gen.positions / seconds * 3600 / 1e6);
+
+    fclose(gen.out);
+    free_tablebases();
+    free_network();
+    report_stats(show_stats, stats_json);
+    return 0;
+}
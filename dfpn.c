@@ -0,0 +1,390 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * dfpn.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "dfpn.h"
+#include "stats.h"
+
+#define MAX_NODE_MOVES (256)
+#define CLOCK_INTERVAL (4096)       // Nodes between looks at the clock.
+#define EPSILON_DIVISOR (4)         // Children run to 1 + 1/4 times the second best.
+
+// Values of a node: proof and disproof numbers, and the distance to mate
+// once it is proven.
+typedef struct {
+    unsigned int pn, dn;
+    unsigned short distance;
+} ProofValue;
+
+static const ProofValue PROVEN = {0, PN_INFINITY, 0};
+static const ProofValue DISPROVEN = {PN_INFINITY, 0, 0};
+static const ProofValue UNEXPLORED = {1, 1, 0};
+
+
+bool init_proof_search(ProofSearch *search, size_t bytes)
+{
+    // Sets up a search whose table uses at most `bytes` of memory, rounded
+    // down to a power of two number of buckets. The clock for the time
+    // limit starts here, so it covers every proof made with the table.
+
+    memset(search, 0, sizeof(ProofSearch));
+    size_t bucket = PROOF_BUCKET_ENTRIES * sizeof(ProofEntry);
+    search->num_buckets = 1;
+    while (search->num_buckets * 2 * bucket <= bytes)
+        search->num_buckets *= 2;
+    search->entries = (ProofEntry*) calloc(search->num_buckets * PROOF_BUCKET_ENTRIES, sizeof(ProofEntry));
+    clock_gettime(CLOCK_MONOTONIC, &search->start_time);
+    return search->entries != NULL;
+}
+
+
+void free_proof_search(ProofSearch *search)
+{
+    free(search->entries);
+    search->entries = NULL;
+}
+
+
+double proof_search_seconds(ProofSearch *search)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - search->start_time.tv_sec) + (now.tv_nsec - search->start_time.tv_nsec) / 1e9;
+}
+
+
+static inline unsigned int add_numbers(unsigned int a, unsigned int b)
+{
+    return (a + b >= PN_INFINITY) ? PN_INFINITY : a + b;
+}
+
+
+static inline Key node_key(Key position, int moves_left)
+{
+    // The same position with a different number of moves left is a
+    // different problem, so the count is mixed into the key.
+
+    return position ^ ((Key) (moves_left + 1) * 0x9E3779B97F4A7C15UL);
+}
+
+
+static ProofEntry *find_entry(ProofSearch *search, Key key)
+{
+    ProofEntry *bucket = search->entries + (key & (search->num_buckets - 1)) * PROOF_BUCKET_ENTRIES;
+    for (int i = 0; i < PROOF_BUCKET_ENTRIES; i++) {
+        if (bucket[i].key == key)
+            return bucket + i;
+    }
+    return NULL;
+}
+
+
+static ProofValue lookup(ProofSearch *search, Key key, ProofValue missing)
+{
+    // Returns the values stored for `key`, or `missing` if there are none.
+
+    ProofEntry *entry = find_entry(search, key);
+    if (entry == NULL)
+        return missing;
+    return (ProofValue) {entry->pn, entry->dn, entry->distance};
+}
+
+
+static void store(ProofSearch *search, Key key, ProofValue value, unsigned long int work)
+{
+    // Saves a node, replacing the entry with the least work in its bucket
+    // if the node isn't there already.
+
+    ProofEntry *entry = find_entry(search, key);
+    if (entry == NULL) {
+        ProofEntry *bucket = search->entries + (key & (search->num_buckets - 1)) * PROOF_BUCKET_ENTRIES;
+        entry = bucket;
+        for (int i = 1; i < PROOF_BUCKET_ENTRIES; i++) {
+            if (bucket[i].work < entry->work)
+                entry = bucket + i;
+        }
+        if (entry->key == 0)
+            search->used++;
+    }
+
+    entry->key = key;
+    entry->pn = value.pn;
+    entry->dn = value.dn;
+    entry->distance = value.distance;
+    entry->work = (work > 0xffffffffUL) ? 0xffffffffU : work;
+}
+
+
+static int generate_moves(Board *board, Move *moves)
+{
+    // Lists the legal moves of the side to move, with every promotion.
+
+    int n = 0;
+    for (int sq = 0; sq < BOARD_DIM * BOARD_DIM; sq++) {
+        Piece piece = *(board->arr + sq);
+        if ((piece & COLOR_BITMASK) != board->turn)
+            continue;
+        Bitboard targets = (Bitboard) 0;
+        get_valid_moves((V2Int) {sq % BOARD_DIM, sq / BOARD_DIM}, &targets, board, true);
+        for (; targets; targets &= targets - 1) {
+            int to = __builtin_ctzl(targets);
+            if ((piece & PIECE_BITMASK) == PAWN && (to / BOARD_DIM == 0 || to / BOARD_DIM == BOARD_DIM - 1)) {
+                for (int type = QUEEN; type >= KNIGHT; type--)
+                    moves[n++] = (Move) {sq, to, type};
+            } else
+                moves[n++] = (Move) {sq, to, QUEEN};
+        }
+    }
+    return n;
+}
+
+
+static Board *play_child(BoardCopy *copy, Board *board, Move move)
+{
+    Board *child = copy_board_local(copy, board);
+    make_promotion((V2Int) {move.from % BOARD_DIM, move.from / BOARD_DIM},
+            (V2Int) {move.to % BOARD_DIM, move.to / BOARD_DIM}, move.promotion, child);
+    return child;
+}
+
+
+static void check_clock(ProofSearch *search)
+{
+    // Stops the search at the time limit and reports progress.
+
+    double seconds = proof_search_seconds(search);
+    if (search->time_limit > 0 && seconds >= search->time_limit)
+        search->stop = true;
+    if (search->progress && seconds >= search->last_report + 1) {
+        size_t capacity = search->num_buckets * PROOF_BUCKET_ENTRIES;
+        fprintf(stderr, "%lu nodes in %.0f s, %.0f nodes/s, table %.1f%% full\n",
+                search->nodes, seconds, search->nodes / seconds, 100.0 * search->used / capacity);
+        search->last_report = seconds;
+    }
+}
+
+
+static ProofValue mid(ProofSearch *search, Board *board, Key key, int moves_left,
+        unsigned int pn_limit, unsigned int dn_limit)
+{
+    // Searches the node until its proof number reaches `pn_limit` or its
+    // disproof number reaches `dn_limit`, then stores and returns its values.
+    // At OR nodes the attacker is to move and one mating move is enough; at
+    // AND nodes every defence must be mated.
+
+    STAT_INC(STAT_SEARCH_NODE);
+    unsigned long int start_nodes = search->nodes++;
+    if (search->nodes % CLOCK_INTERVAL == 0)
+        check_clock(search);
+    bool or_node = board->turn == search->attacker;
+
+    Move moves[MAX_NODE_MOVES];
+    int num_moves = 0;
+    ProofValue value;
+    if (or_node && moves_left == 0)
+        value = DISPROVEN;
+    else if ((num_moves = generate_moves(board, moves)) == 0)
+        value = (!or_node && (in_check(board) & board->turn)) ? PROVEN : DISPROVEN;
+    else if (!or_node && moves_left == 0)
+        value = DISPROVEN;
+    else if (insufficient_material(board))
+        value = DISPROVEN;
+    else
+        value = UNEXPLORED;
+    if (value.pn == 0 || value.dn == 0) {
+        store(search, key, value, 1);
+        return value;
+    }
+
+    // The keys of the children are needed on every pass, so they are
+    // worked out once. Their last known values are kept as well: if a
+    // child's entry is replaced while its siblings are searched, falling
+    // back to (1, 1) would make it look best again, and the two children
+    // could take turns replacing each other forever.
+    int child_moves_left = or_node ? moves_left - 1 : moves_left;
+    Key child_keys[MAX_NODE_MOVES];
+    ProofValue child_values[MAX_NODE_MOVES];
+    for (int i = 0; i < num_moves; i++) {
+        BoardCopy copy;
+        child_keys[i] = node_key(hash_board(play_child(&copy, board, moves[i])), child_moves_left);
+        child_values[i] = UNEXPLORED;
+    }
+
+    while (true) {
+        // At OR nodes the proof number is the smallest of the children's
+        // and the disproof number the sum of theirs; at AND nodes it's the
+        // other way around. A proven node is as far from mate as its
+        // quickest mating move, or its longest defence.
+        unsigned int sum = 0, best = PN_INFINITY, second = PN_INFINITY;
+        int best_child = 0;
+        unsigned short distance = or_node ? 0xffff : 0;
+        for (int i = 0; i < num_moves; i++) {
+            ProofValue child = child_values[i] = lookup(search, child_keys[i], child_values[i]);
+            unsigned int minimized = or_node ? child.pn : child.dn;
+            sum = add_numbers(sum, or_node ? child.dn : child.pn);
+            if (minimized < best) {
+                second = best;
+                best = minimized;
+                best_child = i;
+            } else if (minimized < second)
+                second = minimized;
+            if (child.pn == 0 && (or_node ? child.distance < distance : child.distance > distance))
+                distance = child.distance;
+        }
+
+        value = or_node ? (ProofValue) {best, sum, 0} : (ProofValue) {sum, best, 0};
+        if (value.pn == 0)
+            value.distance = distance + 1;
+        if (value.pn >= pn_limit || value.dn >= dn_limit || search->stop)
+            break;
+
+        // Search the most proving child until it is clearly worse than the
+        // second best, or this node reaches its own limits. Letting it run a
+        // little past the second best (the 1 + epsilon trick of Pawlewicz
+        // and Lew) saves the search from switching between two children over
+        // and over, which costs most when the table is small and their
+        // subtrees are lost.
+        ProofValue child = child_values[best_child];
+        unsigned int switch_limit = add_numbers(second, second / EPSILON_DIVISOR + 1);
+        unsigned int child_pn_limit, child_dn_limit;
+        if (or_node) {
+            child_pn_limit = (pn_limit < switch_limit) ? pn_limit : switch_limit;
+            child_dn_limit = add_numbers(dn_limit - value.dn, child.dn);
+        } else {
+            child_pn_limit = add_numbers(pn_limit - value.pn, child.pn);
+            child_dn_limit = (dn_limit < switch_limit) ? dn_limit : switch_limit;
+        }
+        BoardCopy copy;
+        child_values[best_child] = mid(search, play_child(&copy, board, moves[best_child]), child_keys[best_child],
+                child_moves_left, child_pn_limit, child_dn_limit);
+    }
+
+    store(search, key, value, search->nodes - start_nodes);
+    return value;
+}
+
+
+ProofResult prove_mate(ProofSearch *search, Board *board, int max_moves)
+{
+    // Tries to prove that the side to move can mate within `max_moves`
+    // moves. The table is kept, so `mating_line` can read the proof.
+
+    if (max_moves > MAX_MATE_MOVES)
+        max_moves = MAX_MATE_MOVES;
+    search->attacker = board->turn;
+    search->stop = false;
+
+    ProofValue value = mid(search, board, node_key(hash_board(board), max_moves), max_moves, PN_INFINITY, PN_INFINITY);
+    if (value.pn == 0)
+        return PROOF_MATE;
+    if (value.dn == 0)
+        return PROOF_NO_MATE;
+    return PROOF_UNKNOWN;
+}
+
+
+static ProofValue resolve(ProofSearch *search, Board *board, Key key, int moves_left)
+{
+    // Returns the values of a node, searching it again if the table lost it.
+
+    ProofValue value = lookup(search, key, UNEXPLORED);
+    if (value.pn != 0 && value.dn != 0)
+        value = mid(search, board, key, moves_left, PN_INFINITY, PN_INFINITY);
+    return value;
+}
+
+
+int mating_line(ProofSearch *search, Board *board, int max_moves, Move *line)
+{
+    // Follows a proof found by `prove_mate` into `line`: the attacker's
+    // quickest mating move and the defence that holds out longest, until
+    // mate. The attacker never returns to a position already in the line,
+    // since a repetition isn't progress and could let the defender claim a
+    // draw. Nodes the table has since replaced are searched again, without
+    // the time limit. Returns the number of half-moves, or -1 if there is
+    // no proof or every mating move repeats a position.
+
+    if (max_moves > MAX_MATE_MOVES)
+        max_moves = MAX_MATE_MOVES;
+    double time_limit = search->time_limit;
+    search->time_limit = 0;
+    search->stop = false;
+
+    BoardCopy copies[2];
+    Board *current = copy_board_local(copies, board);
+    Key seen[2 * MAX_MATE_MOVES + 1];
+    seen[0] = hash_board(current);
+    int moves_left = max_moves, length = 0;
+    if (resolve(search, current, node_key(seen[0], moves_left), moves_left).pn != 0)
+        length = -1;
+
+    while (length >= 0) {
+        bool or_node = current->turn == search->attacker;
+        Move moves[MAX_NODE_MOVES];
+        int num_moves = generate_moves(current, moves);
+        if (num_moves == 0)
+            break;
+
+        // Only the attacker's moves already known to mate are looked at
+        // first, since searching the others again could take as long as
+        // the proof.
+        int child_moves_left = or_node ? moves_left - 1 : moves_left;
+        Key positions[MAX_NODE_MOVES];
+        bool repeats[MAX_NODE_MOVES];
+        int best = -1, best_distance = 0;
+        for (int i = 0; i < num_moves; i++) {
+            BoardCopy copy;
+            Board *child = play_child(&copy, current, moves[i]);
+            positions[i] = hash_board(child);
+            repeats[i] = false;
+            for (int j = 0; j <= length; j++)
+                repeats[i] |= seen[j] == positions[i];
+            if (or_node && repeats[i])
+                continue;
+
+            Key key = node_key(positions[i], child_moves_left);
+            ProofValue value = or_node ? lookup(search, key, UNEXPLORED) : resolve(search, child, key, child_moves_left);
+            if (value.pn != 0 && !or_node) {
+                // Every defence of a proven node must be mated too.
+                best = -1;
+                break;
+            }
+            if (value.pn != 0)
+                continue;
+            if (best < 0 || (or_node ? value.distance < best_distance : value.distance > best_distance)) {
+                best = i;
+                best_distance = value.distance;
+            }
+        }
+        // The mating move may have been replaced in the table.
+        for (int i = 0; or_node && best < 0 && i < num_moves; i++) {
+            if (repeats[i])
+                continue;
+            BoardCopy copy;
+            Board *child = play_child(&copy, current, moves[i]);
+            if (resolve(search, child, node_key(positions[i], child_moves_left), child_moves_left).pn == 0)
+                best = i;
+        }
+        if (best < 0) {
+            length = -1;
+            break;
+        }
+
+        line[length++] = moves[best];
+        seen[length] = positions[best];
+        current = play_child(copies + length % 2, current, moves[best]);
+        moves_left = child_moves_left;
+    }
+
+    search->time_limit = time_limit;
+    return length;
+}
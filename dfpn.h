@@ -0,0 +1,69 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * dfpn.h
+*/
+#ifndef DFPN_H
+#define DFPN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+
+// Proves or disproves a forced mate with depth-first proof-number search
+// (df-pn). Every node has a proof number, the least number of leaves that
+// must still be shown to be mates to prove it, and a disproof number, the
+// least number that must be shown not to be. The search always expands
+// the most proving node, which suits mate problems far better than
+// alpha-beta: narrow forcing lines are followed deep while the wide,
+// hopeless ones are left alone.
+// https://www.chessprogramming.org/Proof-Number_Search#Depth-First_Proof-Number_Search
+//
+// Nodes are kept in a fixed size table of buckets indexed by the position's
+// key, so a search can run for as long as it likes in bounded memory. When
+// a bucket is full the entry with the smallest subtree is replaced, since
+// it is the cheapest to recompute. Entries are keyed by the position and
+// the number of moves the attacker has left, and every attacking move
+// lowers that number, so the search can never loop back on itself.
+#define PN_INFINITY (1u << 30)
+#define PROOF_BUCKET_ENTRIES (4)
+#define MAX_MATE_MOVES (128)
+
+typedef enum {
+    PROOF_UNKNOWN,                  // Stopped by the time limit.
+    PROOF_MATE,
+    PROOF_NO_MATE
+} ProofResult;
+
+typedef struct {
+    Key key;                        // Position key mixed with the attacker's moves left; 0 if empty.
+    unsigned int pn, dn;
+    unsigned int work;              // Nodes searched below this one.
+    unsigned short distance;        // Plies to mate, once proven.
+    unsigned short reserved;
+} ProofEntry;
+
+typedef struct {
+    ProofEntry *entries;
+    size_t num_buckets;             // A power of two.
+    size_t used;                    // Entries holding a node.
+    int attacker;                   // The color trying to mate.
+    unsigned long int nodes;
+    double time_limit;              // Seconds, or 0 for none.
+    bool progress;                  // Print progress to stderr every second.
+    bool stop;
+    struct timespec start_time;
+    double last_report;
+} ProofSearch;
+
+
+bool init_proof_search(ProofSearch *search, size_t bytes);
+void free_proof_search(ProofSearch *search);
+double proof_search_seconds(ProofSearch *search);
+ProofResult prove_mate(ProofSearch *search, Board *board, int max_moves);
+int mating_line(ProofSearch *search, Board *board, int max_moves, Move *line);
+
+#endif
@@ -0,0 +1,290 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * engine.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "chessfunc.h"
+#include "book.h"
+#include "tablebase.h"
+#include "nnue.h"
+#include "engine.h"
+#include "stats.h"
+
+
+// Material value of each piece type in centipawns, indexed by PieceType.
+static const int PIECE_VALUES[] = {0, 100, 320, 330, 500, 900, 0};
+// Bonus for a passed pawn by the number of ranks it has advanced.
+static const int PASSED_PAWN[] = {0, 5, 10, 20, 35, 60, 100, 0};
+#define DOUBLED_PAWN (15)
+#define ISOLATED_PAWN (12)
+#define SHELTER_PAWN (8)
+#define BISHOP_PAIR (30)
+// A side without pawns needs to be this far ahead in pieces to win.
+#define WINNING_MARGIN (400)
+#define SCALE_DRAWISH (8)
+#define FILE_A_SQUARES (0x0101010101010101UL)
+
+static __thread PawnEntry pawn_table[1 << PAWN_TABLE_BITS];
+static __thread MaterialEntry material_table[1 << MATERIAL_TABLE_BITS];
+
+
+static Bitboard squares_ahead(int col, int y)
+{
+    // Squares on the rows in front of row `y` from `col`'s point of view.
+    // White moves towards row 0.
+
+    if (col == 0)
+        return ((Bitboard) 1 << (BOARD_DIM * y)) - 1;
+    return (y == BOARD_DIM - 1) ? 0 : ~(Bitboard) 0 << (BOARD_DIM * (y + 1));
+}
+
+
+static Bitboard adjacent_files(int x)
+{
+    return ((x > 0) ? FILE_A_SQUARES << (x - 1) : 0) | ((x < BOARD_DIM - 1) ? FILE_A_SQUARES << (x + 1) : 0);
+}
+
+
+static PawnEntry *probe_pawns(Board *board)
+{
+    // Returns the pawn structure terms of the position, computing them if
+    // they aren't in the table. The table starts out zeroed, which is the
+    // correct entry for key 0, a board without pawns.
+
+    STAT_INC(STAT_PAWN_PROBE);
+    PawnEntry *entry = pawn_table + (board->pawn_key & ((1 << PAWN_TABLE_BITS) - 1));
+    if (entry->key == board->pawn_key) {
+        STAT_INC(STAT_PAWN_HIT);
+        return entry;
+    }
+
+    entry->key = board->pawn_key;
+    entry->pawns[0] = entry->pawns[1] = 0;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        Piece p = *(board->arr + i);
+        if ((p & PIECE_BITMASK) == PAWN)
+            entry->pawns[COLOR_INDEX(p & COLOR_BITMASK)] |= (Bitboard) 1 << i;
+    }
+
+    entry->score = 0;
+    for (int c = 0; c < 2; c++) {
+        int sign = (c == 0) ? 1 : -1;
+        Bitboard own = entry->pawns[c], theirs = entry->pawns[!c];
+        for (Bitboard b = own; b; b &= b - 1) {
+            int sq = __builtin_ctzl(b), x = sq % BOARD_DIM, y = sq / BOARD_DIM;
+            Bitboard file = FILE_A_SQUARES << x, ahead = squares_ahead(c, y);
+            if (own & file & ahead)
+                entry->score -= sign * DOUBLED_PAWN;
+            if (!(own & adjacent_files(x)))
+                entry->score -= sign * ISOLATED_PAWN;
+            // Pawns on their own back rank only come from hand-made boards;
+            // they are scored like pawns that haven't advanced.
+            int advanced = (c == 0) ? BOARD_DIM - 2 - y : y - 1;
+            if (!(theirs & (file | adjacent_files(x)) & ahead))
+                entry->score += sign * PASSED_PAWN[(advanced < 0) ? 0 : advanced];
+        }
+    }
+
+    return entry;
+}
+
+
+static MaterialEntry *probe_material(Board *board)
+{
+    // Returns the material terms of the position, computing them if they
+    // aren't in the table. The key counts the pieces, so it is mixed before
+    // use as an index. It is never 0, since both kings are counted.
+
+    STAT_INC(STAT_MATERIAL_PROBE);
+    Key key = board->material_key;
+    MaterialEntry *entry = material_table + ((key * 0x9E3779B97F4A7C15UL) >> (64 - MATERIAL_TABLE_BITS));
+    if (entry->key == key) {
+        STAT_INC(STAT_MATERIAL_HIT);
+        return entry;
+    }
+
+    int pieces[2] = {0, 0}, pawns[2];
+    entry->key = key;
+    entry->score = 0;
+    for (int c = 0; c < 2; c++) {
+        int col = (c == 0) ? WHITE : BLACK, sign = (c == 0) ? 1 : -1;
+        for (int type = KNIGHT; type <= QUEEN; type++)
+            pieces[c] += PIECE_VALUES[type] * MATERIAL_COUNT(key, col, type);
+        pawns[c] = MATERIAL_COUNT(key, col, PAWN);
+        entry->score += sign * (pieces[c] + PIECE_VALUES[PAWN] * pawns[c]);
+        if (MATERIAL_COUNT(key, col, BISHOP) >= 2)
+            entry->score += sign * BISHOP_PAIR;
+    }
+
+    // Without pawns, a lead of less than a rook's worth is usually a draw.
+    for (int c = 0; c < 2; c++)
+        entry->scale[c] = (pawns[c] == 0 && pieces[c] - pieces[!c] < WINNING_MARGIN) ? SCALE_DRAWISH : SCALE_NORMAL;
+
+    return entry;
+}
+
+
+static int king_shelter(Board *board, PawnEntry *pawns)
+{
+    // Bonus for pawns on the two rows in front of a king that is still on
+    // its first two rows, for white.
+
+    int score = 0;
+    for (int c = 0; c < 2; c++) {
+        int x = board->kings[c] % BOARD_DIM, y = board->kings[c] / BOARD_DIM;
+        if ((c == 0) ? y < BOARD_DIM - 2 : y > 1)
+            continue;
+        Bitboard rows = squares_ahead(c, y) & ~squares_ahead(c, (c == 0) ? y - 2 : y + 2);
+        Bitboard files = (FILE_A_SQUARES << x) | adjacent_files(x);
+        int shelter = __builtin_popcountl(pawns->pawns[c] & rows & files) * SHELTER_PAWN;
+        score += (c == 0) ? shelter : -shelter;
+    }
+    return score;
+}
+
+
+int evaluate(Board *board)
+{
+    // Returns a static score of the position from the point of view of the
+    // player to move. Positive scores are good for that player. Boards made
+    // while a network is loaded are scored by the network.
+
+    if (board->accumulator != NULL)
+        return nnue_evaluate(board, NNUE_AUTO);
+
+    MaterialEntry *material = probe_material(board);
+    PawnEntry *pawns = probe_pawns(board);
+    int score = material->score + pawns->score + king_shelter(board, pawns);
+    if (score != 0)
+        score = score * material->scale[score < 0] / SCALE_NORMAL;
+
+    return (board->turn == WHITE) ? score : -score;
+}
+
+
+static int tablebase_score(int value)
+{
+    // Converts a tablebase value into a search score. Wins and losses are
+    // scored like mates, so shorter wins and longer losses are preferred.
+
+    if (TB_WINS(value))
+        return MATE_SCORE - TB_PLIES(value);
+    if (TB_LOSES(value))
+        return -MATE_SCORE + TB_PLIES(value);
+    return 0;
+}
+
+
+int search(Board *board, int depth, int alpha, int beta)
+{
+    // Negamax alpha-beta search to `depth` half-moves.
+    // https://www.chessprogramming.org/Alpha-Beta
+
+    STAT_INC(STAT_SEARCH_NODE);
+    if (depth == 0) {
+        // Endgames covered by a tablebase have an exact score.
+        STAT_INC(STAT_TB_PROBE);
+        int value = probe_tablebase(board);
+        if (value != TB_UNKNOWN) {
+            STAT_INC(STAT_TB_HIT);
+            return tablebase_score(value);
+        }
+        return evaluate(board);
+    }
+
+    bool any_moves = false;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if ((*(board->arr + i) & COLOR_BITMASK) != board->turn)
+            continue;
+        Bitboard moves = (Bitboard) 0;
+        V2Int from = {i % BOARD_DIM, i / BOARD_DIM};
+        get_valid_moves(from, &moves, board, true);
+
+        for (; moves; moves &= moves - 1) {
+            int j = __builtin_ctzl(moves);
+            V2Int to = {j % BOARD_DIM, j / BOARD_DIM};
+            any_moves = true;
+
+            BoardCopy copy;
+            Board *new_board = copy_board_local(&copy, board);
+            make_move(from, to, new_board);
+            int score = -search(new_board, depth - 1, -beta, -alpha);
+
+            if (score >= beta)
+                return beta;
+            if (score > alpha)
+                alpha = score;
+        }
+    }
+
+    if (!any_moves) {
+        // Checkmate is scored so that quicker mates are preferred.
+        if (in_check(board) & board->turn)
+            return -MATE_SCORE - depth;
+        return 0;
+    }
+
+    return alpha;
+}
+
+
+bool find_move(Board *board, Book *book, int depth, V2Int *from, V2Int *to)
+{
+    // Picks a move for the current player, stored in `from` and `to`.
+    // The opening book is consulted first; the search only runs once the
+    // game has left the book. Returns false if there are no legal moves.
+
+    if (book_move(book, board, from, to))
+        return true;
+
+    bool found = false;
+    int alpha = -2 * MATE_SCORE;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if ((*(board->arr + i) & COLOR_BITMASK) != board->turn)
+            continue;
+        Bitboard moves = (Bitboard) 0;
+        V2Int tmp1 = {i % BOARD_DIM, i / BOARD_DIM};
+        if (board->legal_moves != NULL)
+            moves = *(board->legal_moves + i);
+        else
+            get_valid_moves(tmp1, &moves, board, true);
+
+        for (; moves; moves &= moves - 1) {
+            int j = __builtin_ctzl(moves);
+            V2Int tmp2 = {j % BOARD_DIM, j / BOARD_DIM};
+
+            BoardCopy copy;
+            Board *new_board = copy_board_local(&copy, board);
+            make_move(tmp1, tmp2, new_board);
+            int score = -search(new_board, depth - 1, -2 * MATE_SCORE, -alpha);
+
+            if (!found || score > alpha) {
+                alpha = score;
+                *from = tmp1;
+                *to = tmp2;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+int count_repetitions(Key *history, int num_keys, int since)
+{
+    // Counts earlier occurrences of the last of `num_keys` positions in
+    // `history`, looking back only to index `since`, the last capture or
+    // pawn move, and only at the same side to move.
+
+    int count = 0;
+    for (int i = num_keys - 3; i >= since; i -= 2) {
+        if (history[i] == history[num_keys - 1])
+            count++;
+    }
+    return count;
+}
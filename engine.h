@@ -0,0 +1,43 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * engine.h
+*/
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "book.h"
+
+#define MATE_SCORE (100000)
+#define SEARCH_DEPTH (3)
+
+// The evaluation caches its pawn structure and material terms in tables
+// indexed by the board's pawn and material keys. Each thread has its own
+// tables, so they need no locking.
+#define PAWN_TABLE_BITS (12)
+#define MATERIAL_TABLE_BITS (10)
+#define SCALE_NORMAL (64)       // Endgame scale factors are out of this.
+
+typedef struct {
+    Key key;
+    Bitboard pawns[2];          // Indexed by COLOR_INDEX.
+    int score;                  // Doubled, isolated and passed pawns, for white.
+} PawnEntry;
+
+typedef struct {
+    Key key;
+    int score;                  // Material and imbalance, for white.
+    unsigned char scale[2];     // Applied to the score when each color is ahead.
+} MaterialEntry;
+
+
+int evaluate(Board *board);
+int search(Board *board, int depth, int alpha, int beta);
+bool find_move(Board *board, Book *book, int depth, V2Int *from, V2Int *to);
+int count_repetitions(Key *history, int num_keys, int since);
+
+#endif
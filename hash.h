@@ -0,0 +1,32 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * hash.h
+*/
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+
+#include "chessfunc.h"
+
+// Layout of the Zobrist key table. It follows the Polyglot book format so
+// the same hash can be used to look positions up in opening books.
+#define ZOBRIST_PIECE (0)        // 12 piece kinds * 64 squares.
+#define ZOBRIST_CASTLE (768)     // White short, white long, black short, black long.
+#define ZOBRIST_EP (772)         // One key per en passant file.
+#define ZOBRIST_TURN (780)       // Set when white is to move.
+#define ZOBRIST_SIZE (781)
+
+// A 64 bit hash of a position.
+typedef unsigned long int Key;
+
+
+// The key table is filled on first use, which isn't thread safe, so
+// programs that hash from several threads call `init_zobrist` first.
+void init_zobrist(void);
+bool load_zobrist_keys(char *path);
+Key hash_board(Board *board);
+Key zobrist_piece(Piece piece, Pos pos);
+
+#endif
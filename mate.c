@@ -0,0 +1,141 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * mate.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "pgn.h"
+#include "dfpn.h"
+#include "stats.h"
+
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-m moves] [-M megabytes] [-t seconds] [-f] [-q] [--stats] [--stats-json file] FEN\n", name);
+}
+
+
+static void print_line(Board *board, Move *line, int length)
+{
+    // Prints the mating line in SAN with move numbers.
+
+    BoardCopy copy;
+    Board *current = copy_board_local(&copy, board);
+    for (int i = 0; i < length; i++) {
+        char san[SAN_LEN];
+        move_to_SAN(line[i], current, san);
+        if (current->turn == WHITE)
+            printf(" %d. %s", current->move_count, san);
+        else if (i == 0)
+            printf(" %d... %s", current->move_count, san);
+        else
+            printf(" %s", san);
+        play_move(line[i], current);
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Looks for a forced mate for the side to move, e.g.
+    //   ./mate -m 3 r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4
+    // The FEN may be given as one argument or as several.
+
+    static const struct option LONG_OPTIONS[] = {STAT_LONG_OPTIONS, {NULL, 0, NULL, 0}};
+    int max_moves = 50;
+    long megabytes = 256;
+    double time_limit = 0;
+    bool first_proof = false, quiet = false, show_stats = false;
+    char *stats_json = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:M:t:fq", LONG_OPTIONS, NULL)) != -1) {
+        switch (opt) {
+            case 'm': max_moves = atoi(optarg); break;
+            case 'M': megabytes = atol(optarg); break;
+            case 't': time_limit = atof(optarg); break;
+            case 'f': first_proof = true; break;
+            case 'q': quiet = true; break;
+            case STAT_OPTION_SUMMARY: show_stats = true; break;
+            case STAT_OPTION_JSON: stats_json = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind == argc || max_moves < 1 || max_moves > MAX_MATE_MOVES || megabytes < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char fen[MAX_FEN_LEN] = "";
+    for (int i = optind; i < argc; i++) {
+        if (strlen(fen) + strlen(argv[i]) + 2 > MAX_FEN_LEN) {
+            fprintf(stderr, "FEN too long\n");
+            return 1;
+        }
+        if (i > optind)
+            strcat(fen, " ");
+        strcat(fen, argv[i]);
+    }
+
+    ProofSearch search;
+    if (!init_proof_search(&search, megabytes << 20)) {
+        fprintf(stderr, "Could not allocate %ld MB\n", megabytes);
+        return 1;
+    }
+    search.time_limit = time_limit;
+    search.progress = !quiet;
+
+    Board board;
+    if (!create_board(&board, fen)) {
+        fprintf(stderr, "Invalid FEN: %s\n", fen);
+        free_board(&board);
+        free_proof_search(&search);
+        return 1;
+    }
+    // The first proof found needn't be the shortest, so unless -f is given
+    // the search tries one move, then two, and so on. The table is kept
+    // between tries, since its entries are keyed by the moves left.
+    int moves = first_proof ? max_moves : 1;
+    ProofResult result = prove_mate(&search, &board, moves);
+    while (result == PROOF_NO_MATE && moves < max_moves)
+        result = prove_mate(&search, &board, ++moves);
+    Move line[2 * MAX_MATE_MOVES];
+    int length = (result == PROOF_MATE) ? mating_line(&search, &board, moves, line) : 0;
+    double seconds = proof_search_seconds(&search);
+    unsigned long int nodes = search.nodes;
+
+    if (result == PROOF_MATE && length < 0)
+        printf("mate in %s%d, but every line found repeats a position\n", first_proof ? "at most " : "", moves);
+    else if (result == PROOF_MATE) {
+        if (first_proof)
+            printf("mate in at most %d:", (length + 1) / 2);
+        else
+            printf("mate in %d:", moves);
+        print_line(&board, line, length);
+    } else if (result == PROOF_NO_MATE)
+        printf("no mate in %d moves\n", max_moves);
+    else if (moves > 1 && !first_proof)
+        printf("unknown: no mate in %d moves, stopped after %.1f s\n", moves - 1, seconds);
+    else
+        printf("unknown: stopped after %.1f s\n", seconds);
+
+    size_t capacity = search.num_buckets * PROOF_BUCKET_ENTRIES;
+    printf("%lu nodes in %.2f s, %.0f nodes/s, table %.0f MB, %.1f%% used\n", nodes, seconds,
+            seconds > 0 ? nodes / seconds : 0.0, capacity * sizeof(ProofEntry) / 1048576.0,
+            100.0 * search.used / capacity);
+
+    free_board(&board);
+    free_proof_search(&search);
+    report_stats(show_stats, stats_json);
+    return 0;
+}
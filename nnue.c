@@ -0,0 +1,290 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * nnue.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "chessfunc.h"
+#include "nnue.h"
+
+static Network *network = NULL;
+static NnueKernel best_kernel = NNUE_SCALAR;
+
+
+static bool read_array(void *dest, size_t size, size_t count, FILE *fp)
+{
+    return fread(dest, size, count, fp) == count;
+}
+
+
+bool load_network(char *path)
+{
+    // Loads the network in `path`, replacing any loaded before. Must be
+    // called before the boards that use it are created. Returns false if
+    // the file can't be read or was made for a different architecture.
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    NetworkHeader header;
+    Network *net = (Network*) aligned_alloc(32, sizeof(Network));
+    bool ok = read_array(&header, sizeof(NetworkHeader), 1, fp) &&
+        memcmp(header.magic, NNUE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.features == NNUE_FEATURES && header.hidden == NNUE_HIDDEN && header.layer1 == NNUE_LAYER1 &&
+        read_array(net->feature_bias, sizeof(short), NNUE_HIDDEN, fp) &&
+        read_array(net->feature_weights, sizeof(short), NNUE_FEATURES * NNUE_HIDDEN, fp) &&
+        read_array(net->layer1_bias, sizeof(int), NNUE_LAYER1, fp) &&
+        read_array(net->layer1_weights, sizeof(signed char), NNUE_LAYER1 * 2 * NNUE_HIDDEN, fp) &&
+        read_array(&net->output_bias, sizeof(int), 1, fp) &&
+        read_array(net->output_weights, sizeof(signed char), NNUE_LAYER1, fp) &&
+        fgetc(fp) == EOF;
+    fclose(fp);
+
+    if (!ok) {
+        free(net);
+        return false;
+    }
+    free(network);
+    network = net;
+    best_kernel = nnue_kernel(NNUE_AUTO);
+    return true;
+}
+
+
+void free_network(void)
+{
+    free(network);
+    network = NULL;
+}
+
+
+bool network_loaded(void)
+{
+    return network != NULL;
+}
+
+
+NnueKernel nnue_kernel(NnueKernel kernel)
+{
+    // Returns the kernel `nnue_evaluate` runs when asked for `kernel`: the
+    // fastest one the CPU supports, no faster than the one asked for.
+
+#if defined(__x86_64__) || defined(__i386__)
+    if ((kernel == NNUE_AUTO || kernel == NNUE_AVX2) && __builtin_cpu_supports("avx2"))
+        return NNUE_AVX2;
+    if (kernel != NNUE_SCALAR && __builtin_cpu_supports("ssse3"))
+        return NNUE_SSSE3;
+#endif
+    (void) kernel;
+    return NNUE_SCALAR;
+}
+
+
+static inline void add_feature(short *restrict values, const short *restrict weights)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        values[i] += weights[i];
+}
+
+
+static inline void remove_feature(short *restrict values, const short *restrict weights)
+{
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+        values[i] -= weights[i];
+}
+
+
+static inline int feature_index(int perspective, Piece piece, Pos pos)
+{
+    int own = COLOR_INDEX(piece & COLOR_BITMASK) == perspective;
+    int square = (perspective == 0) ? pos : pos ^ 56;
+    return ((own ? 0 : 6) + (piece & PIECE_BITMASK) - 1) * 64 + square;
+}
+
+
+void refresh_accumulator(Board *board)
+{
+    // Computes the accumulators of `board` from scratch.
+
+    if (board->accumulator == NULL)
+        return;
+
+    for (int p = 0; p < 2; p++) {
+        short *values = board->accumulator->values[p];
+        memcpy(values, network->feature_bias, sizeof(network->feature_bias));
+        for (int sq = 0; sq < BOARD_DIM * BOARD_DIM; sq++) {
+            Piece piece = *(board->arr + sq);
+            if (piece == 0)
+                continue;
+            add_feature(values, network->feature_weights[feature_index(p, piece, sq)]);
+        }
+    }
+}
+
+
+void update_accumulator(Board *board, Pos pos, Piece old, Piece new)
+{
+    // Updates the accumulators of `board` for the piece on `pos` changing
+    // from `old` to `new`. Either may be empty.
+
+    if ((old & ~MOVED) == (new & ~MOVED))
+        return;
+
+    for (int p = 0; p < 2; p++) {
+        short *values = board->accumulator->values[p];
+        if (old != 0)
+            remove_feature(values, network->feature_weights[feature_index(p, old, pos)]);
+        if (new != 0)
+            add_feature(values, network->feature_weights[feature_index(p, new, pos)]);
+    }
+}
+
+
+static inline int clip(int x)
+{
+    return (x < 0) ? 0 : (x > 127) ? 127 : x;
+}
+
+
+static int output_layer(const unsigned char *hidden)
+{
+    int sum = network->output_bias;
+    for (int j = 0; j < NNUE_LAYER1; j++)
+        sum += network->output_weights[j] * hidden[j];
+    return sum / NNUE_OUTPUT_SCALE;
+}
+
+
+static int scalar_evaluate(const Accumulator *acc, int turn)
+{
+    unsigned char input[2 * NNUE_HIDDEN];
+    for (int p = 0; p < 2; p++) {
+        const short *values = acc->values[p == 0 ? turn : !turn];
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+            input[p * NNUE_HIDDEN + i] = clip(values[i]);
+    }
+
+    unsigned char hidden[NNUE_LAYER1];
+    for (int j = 0; j < NNUE_LAYER1; j++) {
+        int sum = network->layer1_bias[j];
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+            sum += network->layer1_weights[j][i] * input[i];
+        hidden[j] = clip(sum >> NNUE_WEIGHT_SHIFT);
+    }
+
+    return output_layer(hidden);
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+// The vector kernels multiply the clipped inputs, as unsigned bytes, by the
+// signed weights with `maddubs`, which adds neighbouring products into 16
+// bits; that can't overflow since both factors are at most 127 in size.
+
+__attribute__((target("ssse3")))
+static int ssse3_evaluate(const Accumulator *acc, int turn)
+{
+    unsigned char input[2 * NNUE_HIDDEN] __attribute__((aligned(32)));
+    const __m128i zero = _mm_setzero_si128(), top = _mm_set1_epi16(127);
+    for (int p = 0; p < 2; p++) {
+        const short *values = acc->values[p == 0 ? turn : !turn];
+        for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m128i a = _mm_load_si128((const __m128i*) (values + i));
+            __m128i b = _mm_load_si128((const __m128i*) (values + i + 8));
+            a = _mm_min_epi16(_mm_max_epi16(a, zero), top);
+            b = _mm_min_epi16(_mm_max_epi16(b, zero), top);
+            _mm_store_si128((__m128i*) (input + p * NNUE_HIDDEN + i), _mm_packus_epi16(a, b));
+        }
+    }
+
+    unsigned char hidden[NNUE_LAYER1];
+    const __m128i ones = _mm_set1_epi16(1);
+    for (int j = 0; j < NNUE_LAYER1; j++) {
+        __m128i sum = zero;
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i += 16) {
+            __m128i x = _mm_load_si128((const __m128i*) (input + i));
+            __m128i w = _mm_load_si128((const __m128i*) (network->layer1_weights[j] + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(x, w), ones));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        hidden[j] = clip((network->layer1_bias[j] + _mm_cvtsi128_si32(sum)) >> NNUE_WEIGHT_SHIFT);
+    }
+
+    return output_layer(hidden);
+}
+
+
+__attribute__((target("avx2")))
+static int avx2_evaluate(const Accumulator *acc, int turn)
+{
+    unsigned char input[2 * NNUE_HIDDEN] __attribute__((aligned(32)));
+    const __m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi16(127);
+    for (int p = 0; p < 2; p++) {
+        const short *values = acc->values[p == 0 ? turn : !turn];
+        for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+            __m256i a = _mm256_load_si256((const __m256i*) (values + i));
+            __m256i b = _mm256_load_si256((const __m256i*) (values + i + 16));
+            a = _mm256_min_epi16(_mm256_max_epi16(a, zero), top);
+            b = _mm256_min_epi16(_mm256_max_epi16(b, zero), top);
+            // Packing works within each 128 bit half, so the quarters
+            // come out as a0 b0 a1 b1 and are put back in order.
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+            _mm256_store_si256((__m256i*) (input + p * NNUE_HIDDEN + i), packed);
+        }
+    }
+
+    // Four neurons at a time, so their sums can be finished together.
+    unsigned char hidden[NNUE_LAYER1];
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int j = 0; j < NNUE_LAYER1; j += 4) {
+        __m256i sums[4];
+        for (int k = 0; k < 4; k++) {
+            sums[k] = zero;
+            for (int i = 0; i < 2 * NNUE_HIDDEN; i += 32) {
+                __m256i x = _mm256_load_si256((const __m256i*) (input + i));
+                __m256i w = _mm256_load_si256((const __m256i*) (network->layer1_weights[j + k] + i));
+                sums[k] = _mm256_add_epi32(sums[k], _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+            }
+        }
+        __m256i sum = _mm256_hadd_epi32(_mm256_hadd_epi32(sums[0], sums[1]), _mm256_hadd_epi32(sums[2], sums[3]));
+        __m128i four = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        four = _mm_add_epi32(four, _mm_loadu_si128((const __m128i*) (network->layer1_bias + j)));
+        four = _mm_srai_epi32(four, NNUE_WEIGHT_SHIFT);
+        four = _mm_min_epi32(_mm_max_epi32(four, _mm_setzero_si128()), _mm_set1_epi32(127));
+        int values[4];
+        _mm_storeu_si128((__m128i*) values, four);
+        for (int k = 0; k < 4; k++)
+            hidden[j + k] = values[k];
+    }
+
+    return output_layer(hidden);
+}
+#endif
+
+
+int nnue_evaluate(Board *board, NnueKernel kernel)
+{
+    // Returns the network's score of the position from the point of view
+    // of the player to move, in centipawns. The board must have been made
+    // while the network was loaded.
+
+    kernel = (kernel == NNUE_AUTO) ? best_kernel : nnue_kernel(kernel);
+    int turn = COLOR_INDEX(board->turn);
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == NNUE_AVX2)
+        return avx2_evaluate(board->accumulator, turn);
+    if (kernel == NNUE_SSSE3)
+        return ssse3_evaluate(board->accumulator, turn);
+#endif
+    return scalar_evaluate(board->accumulator, turn);
+}
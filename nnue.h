@@ -0,0 +1,66 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * nnue.h
+*/
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdbool.h>
+
+#include "chessfunc.h"
+
+// An efficiently updatable neural network (NNUE) evaluation. The input
+// layer has one feature per (piece color, piece type, square) seen from
+// each side, and feeds NNUE_HIDDEN neurons per side. Since a move only
+// turns a few features on or off, the sums of the input layer, the
+// accumulators, are kept on the board and updated by `make_move`; copies
+// of a board carry their accumulators with them. Evaluating a position
+// only computes the small layers after it:
+//   accumulators (side to move first), clipped to 0..127    2 * NNUE_HIDDEN
+//   -> int8 weights, sum >> NNUE_WEIGHT_SHIFT, clipped      NNUE_LAYER1
+//   -> int8 weights, divided by NNUE_OUTPUT_SCALE           centipawns
+// Features are numbered ((own piece ? 0 : 6) + type - 1) * 64 + square,
+// with squares numbered as in `Board` from white's side and mirrored
+// vertically (square ^ 56) from black's.
+// https://www.chessprogramming.org/NNUE
+#define NNUE_MAGIC "CPNN0001"
+#define NNUE_FEATURES (768)
+#define NNUE_LAYER1 (32)
+#define NNUE_WEIGHT_SHIFT (6)
+#define NNUE_OUTPUT_SCALE (16)
+
+typedef enum {
+    NNUE_AUTO,
+    NNUE_SCALAR,
+    NNUE_SSSE3,
+    NNUE_AVX2
+} NnueKernel;
+
+// A network file is this header followed by the parameters in the order
+// of `Network`, little endian, without padding.
+typedef struct {
+    char magic[8];
+    unsigned int features, hidden, layer1;
+    unsigned int reserved;
+} NetworkHeader;
+
+typedef struct {
+    short feature_bias[NNUE_HIDDEN] __attribute__((aligned(32)));
+    short feature_weights[NNUE_FEATURES][NNUE_HIDDEN] __attribute__((aligned(32)));
+    int layer1_bias[NNUE_LAYER1];
+    signed char layer1_weights[NNUE_LAYER1][2 * NNUE_HIDDEN] __attribute__((aligned(32)));
+    int output_bias;
+    signed char output_weights[NNUE_LAYER1] __attribute__((aligned(32)));
+} Network;
+
+
+bool load_network(char *path);
+void free_network(void);
+bool network_loaded(void);
+NnueKernel nnue_kernel(NnueKernel kernel);
+void refresh_accumulator(Board *board);
+void update_accumulator(Board *board, Pos pos, Piece old, Piece new);
+int nnue_evaluate(Board *board, NnueKernel kernel);
+
+#endif
@@ -0,0 +1,700 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * pgn.c
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "stats.h"
+
+// SAN piece letters, indexed by PieceType.
+static const char *SAN_PIECES = " PNBRQK";
+// Games are split between threads in chunks of about this many bytes.
+#define CHUNK_SIZE (4 << 20)
+#define MAX_THREADS (256)
+
+
+void init_game(Game *game)
+{
+    // Sets up an empty game.
+
+    memset(game, 0, sizeof(Game));
+    strcpy(game->result, "*");
+}
+
+
+void free_game(Game *game)
+{
+    // Frees the game's move list.
+
+    free(game->moves);
+    game->moves = NULL;
+    game->num_moves = game->max_moves = 0;
+}
+
+
+void add_move(Game *game, Move move)
+{
+    // Appends a move, growing the move list when it is full.
+
+    if (game->num_moves == game->max_moves) {
+        game->max_moves = game->max_moves ? 2 * game->max_moves : 256;
+        game->moves = (Move*) realloc(game->moves, game->max_moves * sizeof(Move));
+    }
+    game->moves[game->num_moves++] = move;
+}
+
+
+void init_scratch_board(Board *board)
+{
+    // Creates a board for replaying games. It has no legal move cache, since
+    // only the moves actually played are ever looked at.
+
+    create_board(board, START_FEN);
+    free(board->legal_moves);
+    board->legal_moves = NULL;
+    board->num_legal_moves = 0;
+}
+
+
+bool start_game_board(Game *game, Board *board)
+{
+    // Resets `board` to the game's starting position. Returns false if the
+    // game's FEN tag isn't valid, leaving the board in the normal starting
+    // position.
+
+    bool ok = process_FEN(board, game->fen[0] ? game->fen : START_FEN);
+    if (!ok)
+        process_FEN(board, START_FEN);
+    board->winner = 0;
+    init_attack_map(board);
+    init_board_keys(board);
+    refresh_accumulator(board);
+    return ok;
+}
+
+
+void play_move(Move move, Board *board)
+{
+    // Plays a move on the board.
+
+    V2Int from = {move.from % BOARD_DIM, move.from / BOARD_DIM};
+    V2Int to = {move.to % BOARD_DIM, move.to / BOARD_DIM};
+    make_promotion(from, to, move.promotion, board);
+}
+
+
+void square_name(Pos pos, char *name)
+{
+    // Writes the coordinate name of `pos`, such as "e4", into `name`.
+
+    name[0] = 'a' + pos % BOARD_DIM;
+    name[1] = '0' + BOARD_DIM - pos / BOARD_DIM;
+    name[2] = '\0';
+}
+
+
+static bool can_reach(Pos from, Pos to, Board *board)
+{
+    // Returns true if the piece at `from` can legally move to `to`. Only the
+    // one move is checked for safety, rather than every move of the piece.
+
+    V2Int p_pos = {from % BOARD_DIM, from / BOARD_DIM};
+    V2Int t_pos = {to % BOARD_DIM, to / BOARD_DIM};
+    Bitboard moves = (Bitboard) 0;
+    get_valid_moves(p_pos, &moves, board, false);
+    return query_bitboard(&moves, to) && verify_move(p_pos, t_pos, board, true);
+}
+
+
+bool parse_SAN(char *san, Board *board, Move *move)
+{
+    // Finds the legal move described by `san` in the current position.
+    // Returns false if there is no such move, or if it is ambiguous.
+
+    char buf[SAN_LEN + 1];
+    int len = 0;
+    // Drop check marks, annotations and capture signs; they aren't needed
+    // to find the move.
+    for (char *c = san; *c && len < SAN_LEN; c++) {
+        if (!strchr("+#!?x:-", *c) || (*c == '-' && (c[1] == 'O' || c[1] == '0')))
+            buf[len++] = *c;
+    }
+    buf[len] = '\0';
+
+    int col = board->turn;
+    int home = (col == WHITE) ? BOARD_DIM - 1 : 0;
+    move->promotion = QUEEN;
+
+    // Castling moves the king two squares towards the rook.
+    if (strcmp(buf, "O-O") == 0 || strcmp(buf, "0-0") == 0 ||
+            strcmp(buf, "O-O-O") == 0 || strcmp(buf, "0-0-0") == 0) {
+        move->from = 4 + BOARD_DIM * home;
+        move->to = move->from + ((len == 3) ? 2 : -2);
+        if (*(board->arr + move->from) != (KING | col))
+            return false;
+        Bitboard moves = (Bitboard) 0;
+        get_valid_moves((V2Int) {4, home}, &moves, board, true);
+        return query_bitboard(&moves, move->to);
+    }
+
+    // Promotions are written as "e8=Q" or "e8Q".
+    char *eq = strchr(buf, '=');
+    if (eq != NULL) {
+        *eq = eq[1];
+        eq[1] = '\0';
+        len = strlen(buf);
+    }
+    if (len > 2 && strchr("NBRQ", buf[len - 1]) && isdigit(buf[len - 2])) {
+        move->promotion = strchr(SAN_PIECES, buf[--len]) - SAN_PIECES;
+        buf[len] = '\0';
+    }
+
+    PieceType type = PAWN;
+    char *curr = buf;
+    if (*curr && strchr("NBRQK", *curr))
+        type = strchr(SAN_PIECES, *(curr++)) - SAN_PIECES;
+
+    // The last two characters are the target square, anything before them
+    // tells apart pieces that could both move there.
+    int rest = strlen(curr);
+    if (rest < 2 || rest > 4)
+        return false;
+    char *target = curr + rest - 2;
+    if (target[0] < 'a' || target[0] > 'h' || target[1] < '1' || target[1] > '8')
+        return false;
+    move->to = convert_coord(target);
+
+    int want_file = -1, want_rank = -1;
+    for (char *c = curr; c < target; c++) {
+        if (*c >= 'a' && *c <= 'h')
+            want_file = *c - 'a';
+        else if (*c >= '1' && *c <= '8')
+            want_rank = BOARD_DIM - (*c - '0');
+        else
+            return false;
+    }
+
+    bool found = false;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        if ((*(board->arr + i) & (PIECE_BITMASK | COLOR_BITMASK)) != (type | col))
+            continue;
+        if ((want_file >= 0 && i % BOARD_DIM != want_file) || (want_rank >= 0 && i / BOARD_DIM != want_rank))
+            continue;
+        if (!can_reach(i, move->to, board))
+            continue;
+        if (found)
+            return false;
+        move->from = i;
+        found = true;
+    }
+
+    return found;
+}
+
+
+void move_to_SAN(Move move, Board *board, char *san)
+{
+    // Writes `move` in Standard Algebraic Notation into `san`, adding only
+    // as much of the starting square as is needed to tell it apart.
+
+    Piece piece = *(board->arr + move.from);
+    int type = piece & PIECE_BITMASK;
+    int dx = move.to % BOARD_DIM - move.from % BOARD_DIM;
+    char target[3];
+    square_name(move.to, target);
+
+    if (type == KING && abs(dx) == 2) {
+        strcpy(san, (dx > 0) ? "O-O" : "O-O-O");
+    } else {
+        bool capture = *(board->arr + move.to) != 0 || (type == PAWN && dx != 0);
+        char *curr = san;
+
+        if (type == PAWN) {
+            if (capture)
+                *(curr++) = 'a' + move.from % BOARD_DIM;
+        } else {
+            *(curr++) = SAN_PIECES[type];
+
+            // Look for other pieces of the same kind that could go there too.
+            bool ambiguous = false, same_file = false, same_rank = false;
+            for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+                if (i == move.from || *(board->arr + i) == 0)
+                    continue;
+                if ((*(board->arr + i) & (PIECE_BITMASK | COLOR_BITMASK)) != (piece & (PIECE_BITMASK | COLOR_BITMASK)))
+                    continue;
+                if (!can_reach(i, move.to, board))
+                    continue;
+                ambiguous = true;
+                same_file |= i % BOARD_DIM == move.from % BOARD_DIM;
+                same_rank |= i / BOARD_DIM == move.from / BOARD_DIM;
+            }
+            if (ambiguous && (!same_file || same_rank))
+                *(curr++) = 'a' + move.from % BOARD_DIM;
+            if (ambiguous && same_file)
+                *(curr++) = '0' + BOARD_DIM - move.from / BOARD_DIM;
+        }
+
+        if (capture)
+            *(curr++) = 'x';
+        strcpy(curr, target);
+        curr += 2;
+
+        int last_rank = ((piece & COLOR_BITMASK) == WHITE) ? 0 : BOARD_DIM - 1;
+        if (type == PAWN && move.to / BOARD_DIM == last_rank) {
+            *(curr++) = '=';
+            *(curr++) = SAN_PIECES[(int) move.promotion];
+        }
+        *curr = '\0';
+    }
+
+    // Play the move on a copy to see if it gives check or mate.
+    BoardCopy copy;
+    Board *new_board = copy_board_local(&copy, board);
+    play_move(move, new_board);
+    if (in_check(new_board) & new_board->turn)
+        strcat(san, has_legal_move(new_board) ? "+" : "#");
+}
+
+
+static void parse_tag(const char *p, const char *end, Game *game)
+{
+    // Stores the value of a tag pair such as `[White "Carlsen, Magnus"]`
+    // if it is one the game keeps.
+
+    char name[16];
+    int n = 0;
+    for (p++; p < end && !isspace(*p) && *p != ']' && n < 15; p++)
+        name[n++] = *p;
+    name[n] = '\0';
+
+    char *dest = NULL;
+    int size = TAG_LEN;
+    if (strcmp(name, "Event") == 0) dest = game->event;
+    else if (strcmp(name, "Site") == 0) dest = game->site;
+    else if (strcmp(name, "Date") == 0) dest = game->date;
+    else if (strcmp(name, "Round") == 0) dest = game->round;
+    else if (strcmp(name, "White") == 0) dest = game->white;
+    else if (strcmp(name, "Black") == 0) dest = game->black;
+    else if (strcmp(name, "Result") == 0) dest = game->result;
+    else if (strcmp(name, "FEN") == 0) {
+        dest = game->fen;
+        size = MAX_FEN_LEN;
+    }
+    if (dest == NULL)
+        return;
+
+    while (p < end && *p != '"' && *p != '\n')
+        p++;
+    n = 0;
+    for (p++; p < end && *p != '"' && *p != '\n' && n < size - 1; p++) {
+        if (*p == '\\' && p + 1 < end)
+            p++;
+        dest[n++] = *p;
+    }
+    dest[n] = '\0';
+}
+
+
+static bool is_result(const char *token)
+{
+    // Returns true if the token is a game termination marker.
+
+    return strcmp(token, "1-0") == 0 || strcmp(token, "0-1") == 0 ||
+        strcmp(token, "1/2-1/2") == 0 || strcmp(token, "*") == 0;
+}
+
+
+const char *parse_game(const char *text, const char *end, Game *game, Board *board)
+{
+    // Reads the game starting at `text`, checking every move against the
+    // rules as it goes. Returns a pointer just past the game, or NULL if
+    // there are no more games. If a move can't be read, `game->error` says
+    // why and the rest of the game is skipped.
+
+    const char *p = text;
+    while (p < end && (isspace(*p) || (*p == '%' && (p == text || p[-1] == '\n')))) {
+        if (*p == '%') {
+            const char *line_end = memchr(p, '\n', end - p);
+            p = line_end ? line_end : end;
+        } else
+            p++;
+    }
+    if (p == end)
+        return NULL;
+
+    int max_moves = game->max_moves;
+    Move *moves = game->moves;
+    init_game(game);
+    game->moves = moves;
+    game->max_moves = max_moves;
+    game->offset = p - text;
+
+    // Tag pairs, one per line.
+    while (p < end && *p == '[') {
+        const char *line_end = memchr(p, '\n', end - p);
+        if (line_end == NULL)
+            line_end = end;
+        parse_tag(p, line_end, game);
+        p = line_end;
+        while (p < end && isspace(*p))
+            p++;
+    }
+
+    bool failed = false;
+    if (!start_game_board(game, board)) {
+        snprintf(game->error, sizeof(game->error), "bad FEN tag");
+        failed = true;
+    }
+    char token[32];
+
+    // Movetext, up to the result or the next game's tags.
+    while (p < end) {
+        char c = *p;
+        if (isspace(c)) {
+            if (c == '\n' && p + 1 < end && p[1] == '[')
+                return p + 1;
+            p++;
+        } else if (c == '{') {
+            // Brace comments can span lines.
+            const char *close = memchr(p, '}', end - p);
+            p = close ? close + 1 : end;
+        } else if (c == ';' || (c == '%' && (p == text || p[-1] == '\n'))) {
+            // Rest-of-line comments and escaped lines.
+            const char *line_end = memchr(p, '\n', end - p);
+            p = line_end ? line_end : end;
+        } else if (c == '(') {
+            // Variations are skipped, including any nested inside them.
+            int depth = 0;
+            for (; p < end; p++) {
+                if (*p == '{') {
+                    const char *close = memchr(p, '}', end - p);
+                    p = close ? close : end - 1;
+                } else if (*p == '(')
+                    depth++;
+                else if (*p == ')' && --depth == 0) {
+                    p++;
+                    break;
+                }
+            }
+        } else if (c == '$' || c == ')') {
+            // Numeric annotation glyphs and stray parentheses.
+            for (p++; p < end && isdigit(*p); p++);
+        } else {
+            int n = 0;
+            while (p < end && !isspace(*p) && !strchr("{}();", *p)) {
+                if (n < (int) sizeof(token) - 1)
+                    token[n++] = *p;
+                p++;
+            }
+            token[n] = '\0';
+
+            if (is_result(token)) {
+                strcpy(game->result, token);
+                return p;
+            }
+
+            // Move numbers may be written on their own ("12.", "12...")
+            // or stuck to the move ("12.e4").
+            char *san = token;
+            if (isdigit(*san) && strncmp(san, "0-0", 3) != 0) {
+                while (isdigit(*san)) san++;
+                while (*san == '.') san++;
+            }
+            if (*san == '\0' || failed)
+                continue;
+
+            Move move;
+            if (!parse_SAN(san, board, &move)) {
+                snprintf(game->error, sizeof(game->error), "illegal move %.16s at ply %d", san, game->num_moves + 1);
+                failed = true;
+                continue;
+            }
+            add_move(game, move);
+            play_move(move, board);
+        }
+    }
+
+    return p;
+}
+
+
+static void write_tag(FILE *fp, char *name, char *value, char *missing)
+{
+    // Writes a tag pair, escaping quotes and backslashes in the value.
+
+    fprintf(fp, "[%s \"", name);
+    for (char *c = value[0] ? value : missing; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', fp);
+        fputc(*c, fp);
+    }
+    fprintf(fp, "\"]\n");
+}
+
+
+void write_game(FILE *fp, Game *game, Board *board)
+{
+    // Writes the game as PGN, generating the SAN of each move by replaying
+    // it on `board`. Movetext lines are kept under 80 characters.
+
+    write_tag(fp, "Event", game->event, "?");
+    write_tag(fp, "Site", game->site, "?");
+    write_tag(fp, "Date", game->date, "????.??.??");
+    write_tag(fp, "Round", game->round, "?");
+    write_tag(fp, "White", game->white, "?");
+    write_tag(fp, "Black", game->black, "?");
+    write_tag(fp, "Result", game->result, "*");
+    if (game->fen[0])
+        fprintf(fp, "[SetUp \"1\"]\n[FEN \"%s\"]\n", game->fen);
+    fprintf(fp, "\n");
+
+    start_game_board(game, board);
+    int line_len = 0;
+    char word[SAN_LEN + 16], san[SAN_LEN + 4];
+    for (int i = 0; i <= game->num_moves; i++) {
+        if (i == game->num_moves)
+            strcpy(word, game->result);
+        else {
+            move_to_SAN(game->moves[i], board, san);
+            if (board->turn == WHITE)
+                sprintf(word, "%d. %s", board->move_count, san);
+            else if (i == 0)
+                sprintf(word, "%d... %s", board->move_count, san);
+            else
+                strcpy(word, san);
+            play_move(game->moves[i], board);
+        }
+
+        int len = strlen(word);
+        if (line_len > 0 && line_len + 1 + len >= 80) {
+            fputc('\n', fp);
+            line_len = 0;
+        } else if (line_len > 0) {
+            fputc(' ', fp);
+            line_len++;
+        }
+        fputs(word, fp);
+        line_len += len;
+    }
+    fprintf(fp, "\n\n");
+}
+
+
+static const char *next_game_start(const char *p, const char *end)
+{
+    // Returns the start of the first game beginning after `p`, or NULL.
+    // Games are assumed to begin with an Event tag, as the PGN standard
+    // asks for.
+
+    static const char MARKER[] = "\n[Event ";
+    const char *found = memmem(p, end - p, MARKER, sizeof(MARKER) - 1);
+    return found ? found + 1 : NULL;
+}
+
+
+static void process_text(const char *text, const char *end, long base, GameHandler handler,
+        void *ctx, FILE *out, PGNStats *stats)
+{
+    // Reads every game in [text, end) and passes it to the handler.
+
+    Game game;
+    Board board;
+    init_game(&game);
+    init_scratch_board(&board);
+
+    const char *p = text;
+    while (p != NULL && p < end) {
+        const char *start = p;
+        p = parse_game(p, end, &game, &board);
+        if (p == NULL)
+            break;
+        game.offset += base + (start - text);
+        stats->games++;
+        stats->moves += game.num_moves;
+        if (game.error[0])
+            stats->errors++;
+        if (handler != NULL)
+            handler(&game, &board, out, ctx);
+    }
+
+    free_game(&game);
+    free_board(&board);
+}
+
+
+// A piece of the file read by one thread. Its output is buffered until the
+// earlier chunks have been written.
+typedef struct {
+    const char *start, *end;
+    long base;
+    char *output;
+    size_t output_len;
+    PGNStats stats;
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    int num_chunks;
+    int next;
+    GameHandler handler;
+    void *ctx;
+    bool buffer_output;
+} ChunkQueue;
+
+
+static void *chunk_worker(void *arg)
+{
+    // Takes chunks from the queue until there are none left.
+
+    ChunkQueue *queue = (ChunkQueue*) arg;
+    int i;
+    while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->num_chunks) {
+        Chunk *chunk = queue->chunks + i;
+        FILE *out = queue->buffer_output ? open_memstream(&chunk->output, &chunk->output_len) : NULL;
+        process_text(chunk->start, chunk->end, chunk->base, queue->handler, queue->ctx, out, &chunk->stats);
+        if (out != NULL)
+            fclose(out);
+    }
+    flush_stats();
+    return NULL;
+}
+
+
+static void process_stream(FILE *fp, GameHandler handler, void *ctx, FILE *out, PGNStats *stats)
+{
+    // Reads games from `fp` a block at a time, so files of any size (and
+    // pipes) can be read with a fixed amount of memory.
+
+    size_t cap = CHUNK_SIZE, len = 0;
+    char *buf = (char*) malloc(cap);
+    long base = 0;
+    bool eof = false;
+
+    while (!eof || len > 0) {
+        if (!eof) {
+            if (len == cap) {
+                // A single game is bigger than the buffer.
+                cap *= 2;
+                buf = (char*) realloc(buf, cap);
+            }
+            size_t n = fread(buf + len, 1, cap - len, fp);
+            len += n;
+            eof = (n == 0);
+        }
+
+        // Only read up to the last game that is known to be complete.
+        const char *end = buf + len;
+        if (!eof) {
+            const char *last = NULL, *p = buf;
+            while ((p = next_game_start(p, buf + len)) != NULL)
+                last = p++;
+            if (last == NULL)
+                continue;
+            end = last;
+        }
+
+        process_text(buf, end, base, handler, ctx, out, stats);
+        base += end - buf;
+        len -= end - buf;
+        memmove(buf, end, len);
+        if (eof)
+            len = 0;
+    }
+
+    free(buf);
+}
+
+
+PGNStats process_pgn(char *path, int threads, GameHandler handler, void *ctx, FILE *out)
+{
+    // Reads every game in the file at `path` ("-" for stdin) and passes it
+    // to `handler`. With more than one thread the file is mapped and split
+    // at game boundaries into chunks, which the threads share.
+
+    PGNStats stats = {0, 0, 0, 0};
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    // Boards keep a pawn key, so the keys must exist before threads start.
+    init_zobrist();
+
+    bool use_stdin = strcmp(path, "-") == 0;
+    int fd = use_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        stats.errors = -1;
+        return stats;
+    }
+    struct stat st;
+    const char *data = MAP_FAILED;
+    if (threads > 1 && fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (data == MAP_FAILED) {
+        FILE *fp = use_stdin ? stdin : fdopen(fd, "r");
+        process_stream(fp, handler, ctx, out, &stats);
+        if (fp != stdin)
+            fclose(fp);
+    } else {
+        if (!use_stdin)
+            close(fd);
+        madvise((void*) data, st.st_size, MADV_SEQUENTIAL);
+        if (threads > MAX_THREADS)
+            threads = MAX_THREADS;
+
+        // Chunks are handled in rounds, so only a few chunks of output are
+        // held in memory before being written in order.
+        const char *end = data + st.st_size;
+        const char *p = data;
+        int round_size = 4 * threads;
+        Chunk *chunks = (Chunk*) malloc(round_size * sizeof(Chunk));
+        pthread_t workers[MAX_THREADS];
+
+        while (p < end) {
+            ChunkQueue queue = {chunks, 0, 0, handler, ctx, out != NULL};
+            while (queue.num_chunks < round_size && p < end) {
+                const char *chunk_end = (end - p > CHUNK_SIZE) ? next_game_start(p + CHUNK_SIZE, end) : NULL;
+                if (chunk_end == NULL)
+                    chunk_end = end;
+                chunks[queue.num_chunks++] = (Chunk) {p, chunk_end, p - data, NULL, 0, {0, 0, 0, 0}};
+                p = chunk_end;
+            }
+
+            for (int t = 0; t < threads; t++)
+                pthread_create(workers + t, NULL, chunk_worker, &queue);
+            for (int t = 0; t < threads; t++)
+                pthread_join(workers[t], NULL);
+
+            for (int i = 0; i < queue.num_chunks; i++) {
+                if (chunks[i].output != NULL) {
+                    fwrite(chunks[i].output, 1, chunks[i].output_len, out);
+                    free(chunks[i].output);
+                }
+                stats.games += chunks[i].stats.games;
+                stats.moves += chunks[i].stats.moves;
+                stats.errors += chunks[i].stats.errors;
+            }
+        }
+
+        free(chunks);
+        munmap((void*) data, st.st_size);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    stats.seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    return stats;
+}
@@ -0,0 +1,55 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * pgn.h
+*/
+#ifndef PGN_H
+#define PGN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "chessfunc.h"
+
+// Portable Game Notation stores whole games as tag pairs followed by the
+// moves in Standard Algebraic Notation (SAN).
+// https://www.chessprogramming.org/Portable_Game_Notation
+#define SAN_LEN (12)
+#define TAG_LEN (128)
+
+// A game read from or written to a PGN file. The move list is reused
+// between games, so reading many games doesn't allocate for each one.
+typedef struct {
+    char event[TAG_LEN], site[TAG_LEN], date[TAG_LEN], round[TAG_LEN];
+    char white[TAG_LEN], black[TAG_LEN], result[TAG_LEN];
+    char fen[MAX_FEN_LEN];          // Empty when the game starts from the normal position.
+    Move *moves;
+    int num_moves, max_moves;
+    long offset;                    // Byte offset of the game in its file.
+    char error[64];                 // Why the game couldn't be read, if it couldn't.
+} Game;
+
+typedef struct {
+    long games, moves, errors;
+    double seconds;
+} PGNStats;
+
+// Called for every game read by `process_pgn`. Handlers run on several
+// threads at once; anything they write to `out` is kept in file order.
+typedef void (*GameHandler)(Game *game, Board *board, FILE *out, void *ctx);
+
+
+void init_game(Game *game);
+void free_game(Game *game);
+void add_move(Game *game, Move move);
+void init_scratch_board(Board *board);
+bool start_game_board(Game *game, Board *board);
+void play_move(Move move, Board *board);
+void square_name(Pos pos, char *name);
+bool parse_SAN(char *san, Board *board, Move *move);
+void move_to_SAN(Move move, Board *board, char *san);
+const char *parse_game(const char *text, const char *end, Game *game, Board *board);
+void write_game(FILE *fp, Game *game, Board *board);
+PGNStats process_pgn(char *path, int threads, GameHandler handler, void *ctx, FILE *out);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * pgntool.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "chessfunc.h"
+#include "pgn.h"
+#include "stats.h"
+
+// Only the first few bad games are reported.
+#define MAX_REPORTED_ERRORS (20)
+
+
+typedef struct {
+    long reported;
+} ToolContext;
+
+
+static void handle_game(Game *game, Board *board, FILE *out, void *ctx)
+{
+    // Reports games that couldn't be read, and writes the others back out
+    // with freshly generated SAN.
+
+    ToolContext *tool = (ToolContext*) ctx;
+    if (game->error[0]) {
+        if (__atomic_fetch_add(&tool->reported, 1, __ATOMIC_RELAXED) < MAX_REPORTED_ERRORS)
+            fprintf(stderr, "game at byte %ld: %s\n", game->offset, game->error);
+        return;
+    }
+    if (out != NULL)
+        write_game(out, game, board);
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Checks every game in a PGN file, and optionally rewrites it, e.g.
+    //   ./pgntool -j 8 -o clean.pgn games.pgn
+
+    static const struct option LONG_OPTIONS[] = {STAT_LONG_OPTIONS, {NULL, 0, NULL, 0}};
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    char *out_path = NULL;
+    bool show_stats = false;
+    char *stats_json = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:o:", LONG_OPTIONS, NULL)) != -1) {
+        if (opt == 'j')
+            threads = atoi(optarg);
+        else if (opt == 'o')
+            out_path = optarg;
+        else if (opt == STAT_OPTION_SUMMARY)
+            show_stats = true;
+        else if (opt == STAT_OPTION_JSON)
+            stats_json = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-j threads] [-o out.pgn] [--stats] [--stats-json file] file.pgn\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-j threads] [-o out.pgn] [--stats] [--stats-json file] file.pgn\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = NULL;
+    if (out_path != NULL) {
+        out = (strcmp(out_path, "-") == 0) ? stdout : fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    ToolContext tool = {0};
+    PGNStats stats = process_pgn(argv[optind], threads, handle_game, &tool, out);
+    if (out != NULL && out != stdout)
+        fclose(out);
+    if (stats.errors < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    fprintf(stderr, "%ld games, %ld moves, %ld errors in %.2fs (%.0f games/s)\n",
+            stats.games, stats.moves, stats.errors, stats.seconds,
+            stats.seconds > 0 ? stats.games / stats.seconds : 0.0);
+    report_stats(show_stats, stats_json);
+    return stats.errors > 0;
+}
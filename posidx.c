@@ -0,0 +1,222 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * posidx.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "pgn.h"
+#include "posindex.h"
+#include "stats.h"
+
+#define MAX_MOVE_STATS (256)
+
+typedef struct {
+    unsigned short move;
+    long games, results[4];
+} MoveStats;
+
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s build [-j threads] [-M megabytes] index.idx games.pgn...\n", name);
+    fprintf(stderr, "       %s add [-j threads] [-M megabytes] index.idx games.pgn...\n", name);
+    fprintf(stderr, "       %s query [-n games] index.idx FEN\n", name);
+    fprintf(stderr, "options --stats and --stats-json file print profiling counters\n");
+}
+
+
+static int cmp_move_stats(const void *a, const void *b)
+{
+    // Most played moves first.
+
+    long x = ((const MoveStats*) a)->games, y = ((const MoveStats*) b)->games;
+    return (x < y) - (x > y);
+}
+
+
+static void print_game(PositionIndex *index, unsigned int id, int ply, Board *board)
+{
+    // Prints where a game is, and its players if its PGN file can be read.
+
+    static const char *RESULTS[] = {"*", "1-0", "1/2-1/2", "0-1"};
+    const IndexGame *entry = index->games + id;
+    const char *path = index->files[entry->file];
+    printf("  #%-8u ply %-4d %-8s %s:%lu", id, ply, RESULTS[entry->result], path, entry->offset);
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (unsigned long) st.st_size > entry->offset) {
+        const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (text != MAP_FAILED) {
+            Game game;
+            init_game(&game);
+            if (parse_game(text + entry->offset, text + st.st_size, &game, board) != NULL)
+                printf("  %s - %s, %s", game.white[0] ? game.white : "?",
+                        game.black[0] ? game.black : "?", game.date[0] ? game.date : "?");
+            free_game(&game);
+            munmap((void*) text, st.st_size);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+    printf("\n");
+}
+
+
+static int query(char *path, char *fen, int max_games)
+{
+    // Lists the moves played from a position and the games reaching it.
+
+    PositionIndex index;
+    if (!open_index(&index, path)) {
+        fprintf(stderr, "can't open index %s\n", path);
+        return 1;
+    }
+
+    Board board;
+    init_scratch_board(&board);
+    if (!process_FEN(&board, fen)) {
+        fprintf(stderr, "invalid FEN: %s\n", fen);
+        free_board(&board);
+        close_index(&index);
+        return 1;
+    }
+    init_attack_map(&board);
+    init_board_keys(&board);
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    IndexEntry *entries;
+    long num_entries = find_position(&index, hash_board(&board), &entries);
+
+    // Totals per move, counting each game once.
+    MoveStats stats[MAX_MOVE_STATS];
+    int num_stats = 0;
+    long num_games = 0;
+    for (long i = 0; i < num_entries; i++) {
+        if (i > 0 && entries[i].game == entries[i - 1].game)
+            continue;
+        num_games++;
+        int j = 0;
+        while (j < num_stats && stats[j].move != entries[i].move)
+            j++;
+        if (j == num_stats) {
+            if (num_stats == MAX_MOVE_STATS)
+                continue;
+            memset(stats + num_stats++, 0, sizeof(MoveStats));
+            stats[j].move = entries[i].move;
+        }
+        stats[j].games++;
+        stats[j].results[index.games[entries[i].game].result]++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double ms = (end_time.tv_sec - start_time.tv_sec) * 1e3 + (end_time.tv_nsec - start_time.tv_nsec) / 1e6;
+
+    printf("%ld games (%.3f ms)\n", num_games, ms);
+    if (num_stats > 0) {
+        qsort(stats, num_stats, sizeof(MoveStats), cmp_move_stats);
+        printf("\n  %-8s %8s %7s %7s %7s\n", "move", "games", "white", "draw", "black");
+        for (int i = 0; i < num_stats; i++) {
+            char san[SAN_LEN + 4] = "(end)";
+            if (stats[i].move != 0)
+                move_to_SAN(unpack_move(stats[i].move), &board, san);
+            long decided = stats[i].games - stats[i].results[RESULT_UNKNOWN];
+            decided = decided ? decided : 1;
+            printf("  %-8s %8ld %6.1f%% %6.1f%% %6.1f%%\n", san, stats[i].games,
+                    100.0 * stats[i].results[RESULT_WHITE] / decided,
+                    100.0 * stats[i].results[RESULT_DRAW] / decided,
+                    100.0 * stats[i].results[RESULT_BLACK] / decided);
+        }
+    }
+
+    if (num_games > 0 && max_games > 0) {
+        printf("\n");
+        int shown = 0;
+        for (long i = 0; i < num_entries && shown < max_games; i++) {
+            if (i > 0 && entries[i].game == entries[i - 1].game)
+                continue;
+            print_game(&index, entries[i].game, entries[i].ply, &board);
+            shown++;
+        }
+        if (num_games > shown)
+            printf("  ... %ld more\n", num_games - shown);
+    }
+
+    free(entries);
+    free_board(&board);
+    close_index(&index);
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Builds, extends or queries a position index, e.g.
+    //   ./posidx build -j 8 games.idx games.pgn
+    //   ./posidx query games.idx "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    char *command = argv[1];
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_games = 10;
+    long megabytes = 1024;
+    bool show_stats = false;
+    char *stats_json = NULL;
+
+    static const struct option LONG_OPTIONS[] = {STAT_LONG_OPTIONS, {NULL, 0, NULL, 0}};
+    int opt;
+    optind = 2;
+    while ((opt = getopt_long(argc, argv, "j:n:M:", LONG_OPTIONS, NULL)) != -1) {
+        if (opt == 'j')
+            threads = atoi(optarg);
+        else if (opt == 'n')
+            max_games = atoi(optarg);
+        else if (opt == 'M')
+            megabytes = atol(optarg);
+        else if (opt == STAT_OPTION_SUMMARY)
+            show_stats = true;
+        else if (opt == STAT_OPTION_JSON)
+            stats_json = optarg;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (strcmp(command, "query") == 0 && argc - optind == 2) {
+        int status = query(argv[optind], argv[optind + 1], max_games);
+        report_stats(show_stats, stats_json);
+        return status;
+    }
+
+    bool append = strcmp(command, "add") == 0;
+    if ((!append && strcmp(command, "build") != 0) || argc - optind < 2 || megabytes < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    IndexStats stats;
+    if (!build_index(argv[optind], argv + optind + 1, argc - optind - 1, threads, megabytes << 20, append, &stats)) {
+        fprintf(stderr, "couldn't write index %s\n", argv[optind]);
+        return 1;
+    }
+    fprintf(stderr, "indexed %ld games, %ld positions (%ld games with errors) in %.2fs\n",
+            stats.games, stats.positions, stats.errors, stats.seconds);
+    report_stats(show_stats, stats_json);
+    return 0;
+}
@@ -0,0 +1,669 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * posindex.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "pgn.h"
+#include "posindex.h"
+
+// Positions are handed to the shared entry list this many at a time, so
+// the lock is taken a few times per game rather than once per position.
+#define LOCAL_ENTRIES (512)
+#define MAX_THREADS (256)
+// Spilled runs are read back this many entries at a time while merging.
+#define RUN_BUFFER_ENTRIES (8192)
+
+
+// A sorted run of entries, either in memory or spilled to a temporary
+// file and read back a buffer at a time.
+typedef struct {
+    IndexEntry *start;
+    size_t length;                  // Entries left at `start`.
+    FILE *fp;                       // NULL for runs kept in memory.
+    size_t unread;                  // Entries left in the file.
+    IndexEntry *buffer;
+} Run;
+
+// State shared by the threads reading games. Once `max_entries` are
+// waiting, the thread that fills the list sorts it and writes it to a
+// temporary file while the others start a new one. Only one list is
+// written at a time, so at most two are held in memory.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t spilled;
+    IndexEntry *entries;
+    size_t num_entries, max_entries, total_entries;
+    Run *runs;                      // Spilled runs.
+    int num_runs, max_runs;
+    bool spilling, failed;
+    const char *path;               // Temporary files are named after the index.
+    IndexGame *games;
+    size_t num_games, max_games;
+    unsigned int file;
+} Builder;
+
+// Reads entries back out of the blocks of an index, one at a time.
+typedef struct {
+    const PositionIndex *index;
+    unsigned long int block, left;
+    const unsigned char *p;
+    IndexEntry entry;
+} IndexCursor;
+
+// Writes sorted entries into blocks.
+typedef struct {
+    FILE *fp;
+    unsigned long int offset, num_entries;
+    IndexBlock *blocks;
+    unsigned long int num_blocks, max_blocks;
+    IndexEntry prev;
+} IndexWriter;
+
+
+unsigned short pack_move(Move move)
+{
+    // Packs a move into the 16 bits stored with each entry.
+
+    return (move.from << 9) | (move.to << 3) | move.promotion;
+}
+
+
+Move unpack_move(unsigned short move)
+{
+    // Undoes `pack_move`.
+
+    return (Move) {move >> 9, (move >> 3) & 63, move & 7};
+}
+
+
+static int result_code(char *result)
+{
+    // Converts a PGN result tag to the code stored in the game table.
+
+    if (strcmp(result, "1-0") == 0) return RESULT_WHITE;
+    if (strcmp(result, "0-1") == 0) return RESULT_BLACK;
+    if (strcmp(result, "1/2-1/2") == 0) return RESULT_DRAW;
+    return RESULT_UNKNOWN;
+}
+
+
+static int cmp_entries(const void *a, const void *b)
+{
+    // Orders entries by key, then game, then ply.
+
+    const IndexEntry *x = (const IndexEntry*) a, *y = (const IndexEntry*) b;
+    if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+    if (x->game != y->game) return (x->game < y->game) ? -1 : 1;
+    return (int) x->ply - (int) y->ply;
+}
+
+
+static void put_varint(unsigned long int value, IndexWriter *writer)
+{
+    // Writes 7 bits per byte, with the top bit set on all but the last.
+
+    do {
+        unsigned char byte = value & 127;
+        value >>= 7;
+        if (value != 0)
+            byte |= 128;
+        fputc(byte, writer->fp);
+        writer->offset++;
+    } while (value != 0);
+}
+
+
+static unsigned long int get_varint(const unsigned char **p)
+{
+    // Reads a number written by `put_varint`.
+
+    unsigned long int value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = *((*p)++);
+        value |= (unsigned long int) (byte & 127) << shift;
+        shift += 7;
+    } while (byte & 128);
+    return value;
+}
+
+
+static void write_entry(IndexEntry *entry, IndexWriter *writer)
+{
+    // Appends an entry, starting a new block every INDEX_BLOCK_ENTRIES.
+    // Keys are stored as the difference from the previous key, and games as
+    // the difference from the previous game when the key is the same, which
+    // is what makes common positions cheap.
+
+    if (writer->num_entries % INDEX_BLOCK_ENTRIES == 0) {
+        if (writer->num_blocks == writer->max_blocks) {
+            writer->max_blocks = writer->max_blocks ? 2 * writer->max_blocks : 1024;
+            writer->blocks = (IndexBlock*) realloc(writer->blocks, (writer->max_blocks + 1) * sizeof(IndexBlock));
+        }
+        writer->blocks[writer->num_blocks++] = (IndexBlock) {entry->key, writer->offset};
+        writer->prev = (IndexEntry) {entry->key, 0, 0, 0};
+    }
+
+    Key key_delta = entry->key - writer->prev.key;
+    put_varint(key_delta, writer);
+    put_varint((key_delta == 0) ? entry->game - writer->prev.game : entry->game, writer);
+    put_varint(entry->ply, writer);
+    put_varint(entry->move, writer);
+
+    writer->prev = *entry;
+    writer->num_entries++;
+}
+
+
+static void cursor_start(IndexCursor *cursor, const PositionIndex *index, unsigned long int block)
+{
+    // Points the cursor at the first entry of `block`.
+
+    cursor->index = index;
+    cursor->block = block;
+    cursor->left = 0;
+}
+
+
+static bool cursor_next(IndexCursor *cursor)
+{
+    // Decodes the next entry into `cursor->entry`. Returns false at the end
+    // of the index.
+
+    const PositionIndex *index = cursor->index;
+    if (cursor->left == 0) {
+        if (cursor->block >= index->header->num_blocks)
+            return false;
+        unsigned long int first = cursor->block * INDEX_BLOCK_ENTRIES;
+        unsigned long int remaining = index->header->num_entries - first;
+        cursor->left = (remaining < INDEX_BLOCK_ENTRIES) ? remaining : INDEX_BLOCK_ENTRIES;
+        cursor->p = index->data + index->blocks[cursor->block].offset;
+        cursor->entry = (IndexEntry) {index->blocks[cursor->block].first_key, 0, 0, 0};
+        cursor->block++;
+    }
+
+    IndexEntry *entry = &cursor->entry;
+    Key key_delta = get_varint(&cursor->p);
+    unsigned long int game = get_varint(&cursor->p);
+    entry->key += key_delta;
+    entry->game = (key_delta == 0) ? entry->game + game : game;
+    entry->ply = get_varint(&cursor->p);
+    entry->move = get_varint(&cursor->p);
+    cursor->left--;
+    return true;
+}
+
+
+bool open_index(PositionIndex *index, char *path)
+{
+    // Maps the index at `path` into memory. Returns false if it can't be
+    // opened or isn't an index.
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const IndexHeader *header = (const IndexHeader*) map;
+    if (memcmp(header->magic, INDEX_MAGIC, 8) != 0 ||
+            header->files_offset + header->num_files * INDEX_PATH_LEN > (unsigned long int) st.st_size) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    // Lookups jump around the file.
+    madvise(map, st.st_size, MADV_RANDOM);
+
+    index->header = header;
+    index->data = (const unsigned char*) map;
+    index->blocks = (const IndexBlock*) (index->data + header->blocks_offset);
+    index->games = (const IndexGame*) (index->data + header->games_offset);
+    index->files = (const char (*)[INDEX_PATH_LEN]) (index->data + header->files_offset);
+    index->size = st.st_size;
+    return true;
+}
+
+
+void close_index(PositionIndex *index)
+{
+    // Unmaps an index opened with `open_index`.
+
+    if (index->data != NULL)
+        munmap((void*) index->data, index->size);
+    index->data = NULL;
+}
+
+
+long find_position(PositionIndex *index, Key key, IndexEntry **entries)
+{
+    // Finds every entry for the position with hash `key`, in game order.
+    // Sets `*entries` to a new array the caller frees, and returns its
+    // length.
+
+    *entries = NULL;
+    long num_entries = 0, max_entries = 0;
+
+    // The first block starting at or after `key`; the block before it may
+    // end with some matching entries.
+    unsigned long int lo = 0, hi = index->header->num_blocks;
+    while (lo < hi) {
+        unsigned long int mid = (lo + hi) / 2;
+        if (index->blocks[mid].first_key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    IndexCursor cursor;
+    cursor_start(&cursor, index, (lo > 0) ? lo - 1 : 0);
+    while (cursor_next(&cursor) && cursor.entry.key <= key) {
+        if (cursor.entry.key != key)
+            continue;
+        if (num_entries == max_entries) {
+            max_entries = max_entries ? 2 * max_entries : 64;
+            *entries = (IndexEntry*) realloc(*entries, max_entries * sizeof(IndexEntry));
+        }
+        (*entries)[num_entries++] = cursor.entry;
+    }
+
+    return num_entries;
+}
+
+
+static bool spill_run(IndexEntry *entries, size_t n, int number, Builder *builder, Run *run)
+{
+    // Sorts `entries` and writes them to a temporary file, which `run` then
+    // reads from. The file is unlinked as soon as it is open, so it goes
+    // away when it is closed, however the program ends.
+
+    qsort(entries, n, sizeof(IndexEntry), cmp_entries);
+
+    char run_path[PATH_MAX];
+    snprintf(run_path, sizeof(run_path), "%s.run%d", builder->path, number);
+    memset(run, 0, sizeof(Run));
+    if ((run->fp = fopen(run_path, "w+b")) == NULL)
+        return false;
+    unlink(run_path);
+
+    run->unread = n;
+    run->buffer = (IndexEntry*) malloc(RUN_BUFFER_ENTRIES * sizeof(IndexEntry));
+    run->start = run->buffer;
+    return fwrite(entries, sizeof(IndexEntry), n, run->fp) == n && fflush(run->fp) == 0 && fseek(run->fp, 0, SEEK_SET) == 0;
+}
+
+
+static bool refill_run(Run *run)
+{
+    // Reads the next part of a spilled run once its buffer is used up.
+    // Returns false if the file can't be read.
+
+    if (run->length > 0 || run->unread == 0)
+        return true;
+    size_t n = (run->unread < RUN_BUFFER_ENTRIES) ? run->unread : RUN_BUFFER_ENTRIES;
+    run->start = run->buffer;
+    run->length = fread(run->buffer, sizeof(IndexEntry), n, run->fp);
+    run->unread -= n;
+    return run->length == n;
+}
+
+
+static void flush_entries(IndexEntry *local, int n, Builder *builder)
+{
+    // Moves a thread's entries onto the shared list, first spilling the
+    // list if it is full.
+
+    pthread_mutex_lock(&builder->lock);
+    while (builder->num_entries + n > builder->max_entries && builder->spilling)
+        pthread_cond_wait(&builder->spilled, &builder->lock);
+
+    if (builder->num_entries + n > builder->max_entries) {
+        IndexEntry *full = builder->entries;
+        size_t num_full = builder->num_entries;
+        int number = builder->num_runs;
+        builder->entries = (IndexEntry*) malloc(builder->max_entries * sizeof(IndexEntry));
+        builder->num_entries = 0;
+        builder->spilling = true;
+        pthread_mutex_unlock(&builder->lock);
+
+        Run run;
+        bool ok = spill_run(full, num_full, number, builder, &run);
+        free(full);
+
+        pthread_mutex_lock(&builder->lock);
+        if (builder->num_runs == builder->max_runs) {
+            builder->max_runs = builder->max_runs ? 2 * builder->max_runs : 16;
+            builder->runs = (Run*) realloc(builder->runs, builder->max_runs * sizeof(Run));
+        }
+        builder->runs[builder->num_runs++] = run;
+        builder->failed |= !ok;
+        builder->spilling = false;
+        pthread_cond_broadcast(&builder->spilled);
+    }
+
+    memcpy(builder->entries + builder->num_entries, local, n * sizeof(IndexEntry));
+    builder->num_entries += n;
+    builder->total_entries += n;
+    pthread_mutex_unlock(&builder->lock);
+}
+
+
+static void index_game(Game *game, Board *board, FILE *out, void *ctx)
+{
+    // Replays a game from the start and records each position it reaches.
+    // The game's ID for now is its place in the builder's game list; IDs
+    // are put in file order once every game has been read.
+
+    Builder *builder = (Builder*) ctx;
+    (void) out;
+    // A game whose starting position can't be read has nothing to index.
+    if (!start_game_board(game, board))
+        return;
+
+    pthread_mutex_lock(&builder->lock);
+    if (builder->num_games == builder->max_games) {
+        builder->max_games = builder->max_games ? 2 * builder->max_games : 1024;
+        builder->games = (IndexGame*) realloc(builder->games, builder->max_games * sizeof(IndexGame));
+    }
+    unsigned int id = builder->num_games++;
+    builder->games[id] = (IndexGame) {game->offset, builder->file, result_code(game->result)};
+    pthread_mutex_unlock(&builder->lock);
+
+    IndexEntry local[LOCAL_ENTRIES];
+    int n = 0;
+    for (int ply = 0; ply <= game->num_moves && ply <= USHRT_MAX; ply++) {
+        bool last = (ply == game->num_moves);
+        local[n++] = (IndexEntry) {hash_board(board), id, ply, last ? 0 : pack_move(game->moves[ply])};
+        if (!last)
+            play_move(game->moves[ply], board);
+        if (n == LOCAL_ENTRIES) {
+            flush_entries(local, n, builder);
+            n = 0;
+        }
+    }
+    if (n > 0)
+        flush_entries(local, n, builder);
+}
+
+
+typedef struct {
+    IndexGame game;
+    unsigned int id;
+} NumberedGame;
+
+static int cmp_games(const void *a, const void *b)
+{
+    // Orders games by file, then by place in the file.
+
+    const IndexGame *x = &((const NumberedGame*) a)->game, *y = &((const NumberedGame*) b)->game;
+    if (x->file != y->file) return (x->file < y->file) ? -1 : 1;
+    if (x->offset != y->offset) return (x->offset < y->offset) ? -1 : 1;
+    return 0;
+}
+
+
+static unsigned int *number_games(Builder *builder, unsigned int first_id)
+{
+    // Gives the games read IDs in file order, starting at `first_id`.
+    // Threads finish games in any order, so this keeps an index the same
+    // however many threads built it. Returns a new array, which the caller
+    // frees, mapping the IDs the entries were given to the new ones.
+
+    size_t n = builder->num_games;
+    NumberedGame *order = (NumberedGame*) malloc(n * sizeof(NumberedGame));
+    unsigned int *new_id = (unsigned int*) malloc(n * sizeof(unsigned int));
+    for (size_t i = 0; i < n; i++)
+        order[i] = (NumberedGame) {builder->games[i], i};
+    qsort(order, n, sizeof(NumberedGame), cmp_games);
+
+    for (size_t i = 0; i < n; i++) {
+        builder->games[i] = order[i].game;
+        new_id[order[i].id] = first_id + i;
+    }
+
+    free(order);
+    return new_id;
+}
+
+
+static void *sort_run(void *arg)
+{
+    Run *run = (Run*) arg;
+    qsort(run->start, run->length, sizeof(IndexEntry), cmp_entries);
+    return NULL;
+}
+
+
+static bool merge_runs(Run *runs, int num_runs, PositionIndex *old, unsigned int *new_id, IndexWriter *writer)
+{
+    // Writes the sorted runs and the entries of the old index (if any) as
+    // one sorted sequence. There are only a few runs, so the smallest head
+    // is found by looking at each of them. The runs still hold the IDs the
+    // games had while they were read, so the entries for each key are
+    // collected, given their new IDs and put back in game order before they
+    // are written. Returns false if a spilled run can't be read.
+
+    IndexCursor cursor;
+    bool have_old = false, ok = true;
+    if (old != NULL) {
+        cursor_start(&cursor, old, 0);
+        have_old = cursor_next(&cursor);
+    }
+    for (int i = 0; i < num_runs; i++)
+        ok = refill_run(runs + i) && ok;
+
+    IndexEntry *group = NULL;
+    size_t group_length = 0, max_group = 0;
+    while (true) {
+        int best = -1;
+        IndexEntry *best_entry = have_old ? &cursor.entry : NULL;
+        for (int i = 0; i < num_runs; i++) {
+            if (runs[i].length > 0 && (best_entry == NULL || cmp_entries(runs[i].start, best_entry) < 0)) {
+                best = i;
+                best_entry = runs[i].start;
+            }
+        }
+
+        if (group_length > 0 && (best_entry == NULL || best_entry->key != group[0].key)) {
+            qsort(group, group_length, sizeof(IndexEntry), cmp_entries);
+            for (size_t i = 0; i < group_length; i++)
+                write_entry(group + i, writer);
+            group_length = 0;
+        }
+        if (best_entry == NULL)
+            break;
+
+        if (group_length == max_group) {
+            max_group = max_group ? 2 * max_group : 256;
+            group = (IndexEntry*) realloc(group, max_group * sizeof(IndexEntry));
+        }
+        group[group_length] = *best_entry;
+        if (best < 0)
+            have_old = cursor_next(&cursor);
+        else {
+            group[group_length].game = new_id[best_entry->game];
+            runs[best].start++;
+            runs[best].length--;
+            ok = refill_run(runs + best) && ok;
+        }
+        group_length++;
+    }
+
+    free(group);
+    return ok;
+}
+
+
+bool build_index(char *path, char **pgn_paths, int num_paths, int threads, size_t memory, bool append, IndexStats *stats)
+{
+    // Indexes every game in the PGN files. With `append`, the games are
+    // added to the existing index at `path`; its entries are merged with
+    // the new ones rather than replayed. The new index is written next to
+    // the old one and renamed over it once complete. Entries beyond about
+    // `memory` bytes are sorted in runs kept in temporary files.
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    memset(stats, 0, sizeof(IndexStats));
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    // Set up the keys before any thread needs them.
+    init_zobrist();
+
+    PositionIndex old;
+    PositionIndex *old_index = NULL;
+    if (append && open_index(&old, path))
+        old_index = &old;
+    unsigned long int old_games = old_index ? old.header->num_games : 0;
+    unsigned long int old_files = old_index ? old.header->num_files : 0;
+
+    Builder builder;
+    memset(&builder, 0, sizeof(Builder));
+    pthread_mutex_init(&builder.lock, NULL);
+    pthread_cond_init(&builder.spilled, NULL);
+    builder.path = path;
+    // Two lists of entries can be held at once, one filling while the other
+    // is written out.
+    builder.max_entries = memory / (2 * sizeof(IndexEntry));
+    if (builder.max_entries < LOCAL_ENTRIES)
+        builder.max_entries = LOCAL_ENTRIES;
+    builder.entries = (IndexEntry*) malloc(builder.max_entries * sizeof(IndexEntry));
+
+    bool ok = true;
+    for (int i = 0; i < num_paths && ok; i++) {
+        builder.file = old_files + i;
+        PGNStats pgn_stats = process_pgn(pgn_paths[i], threads, index_game, &builder, NULL);
+        if (pgn_stats.errors < 0)
+            ok = false;
+        else
+            stats->errors += pgn_stats.errors;
+    }
+    ok = ok && !builder.failed;
+
+    FILE *fp = NULL;
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (ok)
+        ok = (fp = fopen(tmp_path, "wb")) != NULL;
+
+    if (ok) {
+        unsigned int *new_id = number_games(&builder, old_games);
+        stats->games = builder.num_games;
+        stats->positions = builder.total_entries;
+
+        // Sort a run per thread of the entries still in memory, then merge
+        // them with the spilled runs while writing.
+        Run *runs = (Run*) calloc(builder.num_runs + threads, sizeof(Run));
+        memcpy(runs, builder.runs, builder.num_runs * sizeof(Run));
+        Run *memory_runs = runs + builder.num_runs;
+        pthread_t workers[MAX_THREADS];
+        size_t run_length = (builder.num_entries + threads - 1) / threads;
+        for (int t = 0; t < threads; t++) {
+            size_t start = t * run_length;
+            if (start > builder.num_entries) start = builder.num_entries;
+            size_t end = start + run_length;
+            if (end > builder.num_entries) end = builder.num_entries;
+            memory_runs[t].start = builder.entries + start;
+            memory_runs[t].length = end - start;
+            pthread_create(workers + t, NULL, sort_run, memory_runs + t);
+        }
+        for (int t = 0; t < threads; t++)
+            pthread_join(workers[t], NULL);
+
+        IndexHeader header;
+        memset(&header, 0, sizeof(IndexHeader));
+        fwrite(&header, sizeof(IndexHeader), 1, fp);
+        IndexWriter writer;
+        memset(&writer, 0, sizeof(IndexWriter));
+        writer.fp = fp;
+        writer.offset = sizeof(IndexHeader);
+        ok = merge_runs(runs, builder.num_runs + threads, old_index, new_id, &writer);
+        free(runs);
+        free(new_id);
+
+        // Tables go after the blocks, 8 byte aligned.
+        while (writer.offset % 8 != 0) {
+            fputc(0, fp);
+            writer.offset++;
+        }
+        if (writer.blocks == NULL)
+            writer.blocks = (IndexBlock*) malloc(sizeof(IndexBlock));
+        writer.blocks[writer.num_blocks] = (IndexBlock) {0, writer.offset};
+
+        memcpy(header.magic, INDEX_MAGIC, 8);
+        header.num_entries = writer.num_entries;
+        header.num_blocks = writer.num_blocks;
+        header.num_games = old_games + builder.num_games;
+        header.num_files = old_files + num_paths;
+        header.blocks_offset = writer.offset;
+        header.games_offset = header.blocks_offset + (header.num_blocks + 1) * sizeof(IndexBlock);
+        header.files_offset = header.games_offset + header.num_games * sizeof(IndexGame);
+
+        fwrite(writer.blocks, sizeof(IndexBlock), header.num_blocks + 1, fp);
+        if (old_index)
+            fwrite(old.games, sizeof(IndexGame), old_games, fp);
+        fwrite(builder.games, sizeof(IndexGame), builder.num_games, fp);
+        if (old_index)
+            fwrite(old.files, INDEX_PATH_LEN, old_files, fp);
+        for (int i = 0; i < num_paths; i++) {
+            // Full paths, so the games can be found from anywhere.
+            char name[INDEX_PATH_LEN] = {0};
+            char full[PATH_MAX];
+            strncpy(name, realpath(pgn_paths[i], full) ? full : pgn_paths[i], INDEX_PATH_LEN - 1);
+            fwrite(name, INDEX_PATH_LEN, 1, fp);
+        }
+
+        fseek(fp, 0, SEEK_SET);
+        fwrite(&header, sizeof(IndexHeader), 1, fp);
+        ok = !ferror(fp) && ok;
+        ok = (fclose(fp) == 0) && ok;
+        free(writer.blocks);
+    }
+
+    if (old_index)
+        close_index(old_index);
+    if (ok)
+        ok = rename(tmp_path, path) == 0;
+    else if (fp != NULL)
+        remove(tmp_path);
+
+    for (int i = 0; i < builder.num_runs; i++) {
+        if (builder.runs[i].fp != NULL)
+            fclose(builder.runs[i].fp);
+        free(builder.runs[i].buffer);
+    }
+    free(builder.runs);
+    free(builder.entries);
+    free(builder.games);
+    pthread_cond_destroy(&builder.spilled);
+    pthread_mutex_destroy(&builder.lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    stats->seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    return ok;
+}
@@ -0,0 +1,81 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * posindex.h
+*/
+#ifndef POSINDEX_H
+#define POSINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+
+// A position index records every position reached in a set of PGN files,
+// so the games passing through a position can be found without replaying
+// them. The file is a header, then the entries sorted by key and packed
+// into blocks, then a table of block start keys, a table of games and a
+// table of PGN file names. A lookup is a binary search over the block
+// table followed by decoding a block or two.
+#define INDEX_MAGIC "CPIX0001"
+#define INDEX_BLOCK_ENTRIES (256)
+#define INDEX_PATH_LEN (256)
+
+// Game results, as stored in the game table.
+#define RESULT_UNKNOWN (0)
+#define RESULT_WHITE (1)
+#define RESULT_DRAW (2)
+#define RESULT_BLACK (3)
+
+// One position of one game, and the move played from it. Moves are packed
+// as (from << 9) | (to << 3) | promotion; 0 means the game ended there.
+typedef struct {
+    Key key;
+    unsigned int game;
+    unsigned short ply;
+    unsigned short move;
+} IndexEntry;
+
+typedef struct {
+    char magic[8];
+    unsigned long int num_entries, num_blocks, num_games, num_files;
+    unsigned long int blocks_offset, games_offset, files_offset;
+} IndexHeader;
+
+// Where each block starts. One extra entry marks the end of the last block.
+typedef struct {
+    Key first_key;
+    unsigned long int offset;
+} IndexBlock;
+
+typedef struct {
+    unsigned long int offset;       // Byte offset of the game in its PGN file.
+    unsigned int file;
+    unsigned int result;
+} IndexGame;
+
+// An index mapped into memory.
+typedef struct {
+    const IndexHeader *header;
+    const unsigned char *data;
+    const IndexBlock *blocks;
+    const IndexGame *games;
+    const char (*files)[INDEX_PATH_LEN];
+    size_t size;
+} PositionIndex;
+
+typedef struct {
+    long games, positions, errors;
+    double seconds;
+} IndexStats;
+
+
+unsigned short pack_move(Move move);
+Move unpack_move(unsigned short move);
+bool open_index(PositionIndex *index, char *path);
+void close_index(PositionIndex *index);
+long find_position(PositionIndex *index, Key key, IndexEntry **entries);
+bool build_index(char *path, char **pgn_paths, int num_paths, int threads, size_t memory, bool append, IndexStats *stats);
+
+#endif
@@ -7,10 +7,17 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 
 #include "gfx.h"
 
 #include "chessfunc.h"
+#include "hash.h"
+#include "book.h"
+#include "tablebase.h"
+#include "nnue.h"
+#include "engine.h"
+#include "stats.h"
 
 int main(int argc, char *argv[])
 {
@@ -18,6 +25,44 @@ int main(int argc, char *argv[])
     const int MARGIN = 50;
     const int SQ_SZ = 50;
 
+    // Command line options:
+    //   -c          Play against the computer, which takes black.
+    //   -b <book>   Polyglot opening book used by the computer.
+    //   -k <keys>   Zobrist keys to use instead of Polyglot's (781 big-endian numbers).
+    //   -t <dir>    Directory of endgame tablebases made by `tbgen`.
+    //   -n <net>    Evaluation network (see nnue.h) used by the computer.
+    //   --stats     Print the profiling counters on exit.
+    //   --stats-json <file>  Write the counters as JSON on exit.
+    int computer = 0;
+    bool show_stats = false;
+    char *stats_json = NULL;
+    Book book = {NULL, 0, 0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0)
+            computer = BLACK;
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            if (!open_book(&book, argv[++i]))
+                fprintf(stderr, "Could not open book %s\n", argv[i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            if (!load_zobrist_keys(argv[++i]))
+                fprintf(stderr, "Could not load keys from %s\n", argv[i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (load_tablebases(argv[++i]) == 0)
+                fprintf(stderr, "No tablebases found in %s\n", argv[i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            if (!load_network(argv[++i]))
+                fprintf(stderr, "Could not load network %s\n", argv[i]);
+        } else if (strcmp(argv[i], "--stats") == 0)
+            show_stats = true;
+        else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+            stats_json = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-c] [-b book.bin] [-k keys.bin] [-t dir] [-n net.nnue] [--stats] [--stats-json file]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(time(NULL));
+
     gfx_open(WIN_SZ, WIN_SZ, "Chess");
     gfx_clear_color(150, 150, 150);
 
@@ -27,7 +72,6 @@ int main(int argc, char *argv[])
 
     Pos pos, selected_pos;
     Piece *selected;
-    int num_moves;
     Bitboard moves = 0;
 
     // printf("%d\n", total_moves(board, 4));
@@ -44,6 +88,20 @@ int main(int argc, char *argv[])
         gfx_color(0, 0, 0);
         gfx_text(MARGIN, WIN_SZ - 10, "(q) Quit    (r) Retire");
 
+        if (board->turn == computer && !board->winner) {
+            // Let the computer move, showing the player's move while it thinks.
+            gfx_flush();
+            V2Int from, to;
+            if (find_move(board, &book, SEARCH_DEPTH, &from, &to)) {
+                make_move(from, to, board);
+                reset_highlights(PREVIOUS, board);
+                set_highlight(from.x + BOARD_DIM * from.y, PREVIOUS, board);
+                set_highlight(to.x + BOARD_DIM * to.y, PREVIOUS, board);
+            }
+            update_winner(board);
+            continue;
+        }
+
         c = gfx_wait();
         // Reset the selected squares and availible squares.
         reset_highlights(SELECTED, board);
@@ -65,12 +123,10 @@ int main(int argc, char *argv[])
                 // selected = get_piece(pos, board);
                 selected = board->arr + pos;
                 if (*selected != 0 && (*selected & COLOR_BITMASK) == board->turn) {
-                    // If the user selected one of their own pieces, generate a list of
-                    // valid moves using the `get_valid_moves` function.
+                    // If the user selected one of their own pieces, look up its valid
+                    // moves in the board's legal move cache.
                     selected_pos = pos;
-                    moves = (Bitboard) 0;
-                    
-                    num_moves = get_valid_moves(tmp, &moves, board, 1);
+                    moves = *(board->legal_moves + pos);
                     // Highlight the selected position.
                     set_highlight(pos, SELECTED, board);
                     *(board->highlights + AVAILIBLE) = moves;
@@ -89,22 +145,10 @@ int main(int argc, char *argv[])
 
 
                         // Test to see if the game is over.
-                        Bitboard attacked = attacked_positions(board->turn, board, true);
-                        if (attacked == (Bitboard) 0) {
-                            // Current player in has no valid moves.
-                            if (in_check(board) & board->turn) // Checkmate.
-                                board->winner = (board->turn == WHITE) ? BLACK : WHITE;
-                            else // Stalemate.
-                                board->winner = COLOR_BITMASK;
-                        }
-
-                        // 50 move rule stalemate.
-                        if (board->half_move_clock == 50)
-                            board->winner = COLOR_BITMASK;
+                        update_winner(board);
 
                     }
 
-                    num_moves = 0;
                     moves = (Bitboard) 0;
                 }
             }
@@ -113,6 +157,10 @@ int main(int argc, char *argv[])
 
     // Free up dynamic memory.
     free_board(board);
+    close_book(&book);
+    free_tablebases();
+    free_network();
+    report_stats(show_stats, stats_json);
 
     return 0;
 }
@@ -0,0 +1,443 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * selfplay.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "chessfunc.h"
+#include "hash.h"
+#include "book.h"
+#include "tablebase.h"
+#include "nnue.h"
+#include "engine.h"
+#include "pgn.h"
+#include "stats.h"
+
+// Plays the engine against itself with two settings, A and B, and decides
+// which is stronger. Each opening is played twice with the colors swapped,
+// and a sequential probability ratio test (SPRT) stops the match as soon
+// as the results are conclusive.
+// https://www.chessprogramming.org/Sequential_Probability_Ratio_Test
+#define MAX_THREADS (256)
+#define MAX_OPENING_MOVES (32)
+
+typedef struct {
+    char fen[MAX_FEN_LEN];
+    Move moves[MAX_OPENING_MOVES];  // Played from `fen` before the engines take over.
+    int num_moves;
+} Opening;
+
+typedef struct {
+    char name[TAG_LEN];
+    int depth;
+} Player;
+
+typedef struct {
+    Player players[2];              // A, then B.
+    Opening *openings;
+    int num_openings;
+    int num_games;
+    Book book;
+    FILE *pgn;
+
+    // SPRT bounds on the Elo difference of A over B.
+    double elo0, elo1, alpha, beta;
+
+    pthread_mutex_t lock;
+    int next_game;                  // Next game for a thread to start.
+    int wins, draws, losses;        // From A's point of view.
+    bool stop;
+} Match;
+
+
+static double expected_score(double elo)
+{
+    return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+
+static double sprt_llr(Match *match)
+{
+    // Log likelihood ratio of the results under elo1 versus elo0, using
+    // the normal approximation to the game score distribution.
+
+    int n = match->wins + match->draws + match->losses;
+    if (n == 0 || match->wins + match->losses == 0)
+        return 0.0;
+
+    double w = (double) match->wins / n, d = (double) match->draws / n;
+    double score = w + d / 2;
+    double variance = w + d / 4 - score * score;
+    if (variance <= 0)
+        return 0.0;
+
+    double s0 = expected_score(match->elo0), s1 = expected_score(match->elo1);
+    return n * (s1 - s0) * (2 * score - s0 - s1) / (2 * variance);
+}
+
+
+static void report(Match *match, int game, double llr, double lower, double upper)
+{
+    // Prints the standing after a game: results, Elo estimate with a 95%
+    // interval, and the SPRT statistic between its bounds.
+
+    int n = match->wins + match->draws + match->losses;
+    double score = (match->wins + match->draws / 2.0) / n;
+    double w = (double) match->wins / n, d = (double) match->draws / n;
+    double margin = 1.96 * sqrt(fmax(w + d / 4 - score * score, 0) / n);
+
+    fprintf(stderr, "game %5d: +%d =%d -%d  score %.3f", game, match->wins, match->draws, match->losses, score);
+    if (score > 0 && score < 1) {
+        double low = fmax(score - margin, 1e-6), high = fmin(score + margin, 1 - 1e-6);
+        fprintf(stderr, "  elo %+.1f [%+.1f, %+.1f]", -400 * log10(1 / score - 1),
+                -400 * log10(1 / low - 1), -400 * log10(1 / high - 1));
+    }
+    fprintf(stderr, "  llr %.2f [%.2f, %.2f]\n", llr, lower, upper);
+}
+
+
+static void play_game(Match *match, int index, Game *game, Key **history, int *max_keys)
+{
+    // Plays game `index`. Even games give A white, odd games give B white,
+    // and both games of a pair start from the same opening.
+
+    Opening *opening = match->openings + (index / 2) % match->num_openings;
+    Player *white = match->players + (index % 2);
+    Player *black = match->players + !(index % 2);
+
+    Board board;
+    create_board(&board, opening->fen);
+
+    // Start a new game, keeping the move list's memory.
+    Move *moves = game->moves;
+    int max_moves = game->max_moves;
+    init_game(game);
+    game->moves = moves;
+    game->max_moves = max_moves;
+    strcpy(game->event, "selfplay");
+    snprintf(game->round, TAG_LEN, "%d", index + 1);
+    strcpy(game->white, white->name);
+    strcpy(game->black, black->name);
+    if (strcmp(opening->fen, START_FEN) != 0)
+        strcpy(game->fen, opening->fen);
+
+    // Positions since the last capture or pawn move, for repetitions.
+    int num_keys = 0, since = 0;
+    (*history)[num_keys++] = hash_board(&board);
+    update_winner(&board);
+
+    while (!board.winner) {
+        Move move;
+        int ply = game->num_moves;
+        if (ply < opening->num_moves)
+            move = opening->moves[ply];
+        else {
+            Player *player = (board.turn == WHITE) ? white : black;
+            V2Int from, to;
+            if (!find_move(&board, &match->book, player->depth, &from, &to))
+                break;
+            move = (Move) {from.x + BOARD_DIM * from.y, to.x + BOARD_DIM * to.y, QUEEN};
+        }
+
+        add_move(game, move);
+        play_move(move, &board);
+        update_winner(&board);
+
+        if (board.half_move_clock == 0)
+            since = num_keys;
+        if (num_keys == *max_keys) {
+            *max_keys *= 2;
+            *history = (Key*) realloc(*history, *max_keys * sizeof(Key));
+        }
+        (*history)[num_keys++] = hash_board(&board);
+        if (count_repetitions(*history, num_keys, since) >= 2)
+            board.winner = COLOR_BITMASK;
+    }
+
+    if (board.winner == WHITE)
+        strcpy(game->result, "1-0");
+    else if (board.winner == BLACK)
+        strcpy(game->result, "0-1");
+    else
+        strcpy(game->result, "1/2-1/2");
+
+    free_board(&board);
+}
+
+
+static void *match_worker(void *arg)
+{
+    // Plays games until the match is over, one at a time.
+
+    Match *match = (Match*) arg;
+    Game game;
+    init_game(&game);
+    Board scratch;
+    init_scratch_board(&scratch);
+    int max_keys = 256;
+    Key *history = (Key*) malloc(max_keys * sizeof(Key));
+
+    while (true) {
+        pthread_mutex_lock(&match->lock);
+        int index = match->stop ? match->num_games : match->next_game++;
+        pthread_mutex_unlock(&match->lock);
+        if (index >= match->num_games)
+            break;
+
+        play_game(match, index, &game, &history, &max_keys);
+
+        pthread_mutex_lock(&match->lock);
+        bool a_white = (index % 2 == 0);
+        if (strcmp(game.result, "1/2-1/2") == 0)
+            match->draws++;
+        else if ((strcmp(game.result, "1-0") == 0) == a_white)
+            match->wins++;
+        else
+            match->losses++;
+        if (match->pgn != NULL)
+            write_game(match->pgn, &game, &scratch);
+
+        double llr = sprt_llr(match);
+        double lower = log(match->beta / (1 - match->alpha));
+        double upper = log((1 - match->beta) / match->alpha);
+        report(match, match->wins + match->draws + match->losses, llr, lower, upper);
+        if (!match->stop && (llr <= lower || llr >= upper)) {
+            match->stop = true;
+            fprintf(stderr, "SPRT: %s\n", (llr >= upper) ? "H1 accepted, A is stronger" : "H0 accepted, A is not stronger");
+        }
+        pthread_mutex_unlock(&match->lock);
+    }
+
+    free(history);
+    free_game(&game);
+    free_board(&scratch);
+    flush_stats();
+    return NULL;
+}
+
+
+static int load_openings(char *path, Opening **openings)
+{
+    // Reads one position per line from a FEN or EPD file. EPD lines only
+    // have the first four FEN fields, so the move counters are added.
+    // Lines that aren't valid positions are reported and skipped.
+    // Returns the number of openings, or -1 if the file can't be read.
+
+    // The longest each FEN field can be: 8 ranks of 8 pieces with 7
+    // slashes, the side to move, castling rights, en passant square and
+    // the two counters. EPD operations after the fourth field are ignored.
+    static const int FIELD_LEN[6] = {71, 1, 4, 2, 6, 6};
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+
+    int n = 0, max = 64, line_number = 0;
+    *openings = (Opening*) malloc(max * sizeof(Opening));
+    char line[512];
+    Board check;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        char fields[6][MAX_FEN_LEN];
+        int num_fields = sscanf(line, "%127s %127s %127s %127s %127s %127s",
+                fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+        if (num_fields < 1 || fields[0][0] == '#')
+            continue;
+        bool counters = num_fields == 6 && isdigit(fields[4][0]) && isdigit(fields[5][0]);
+
+        bool valid = num_fields >= 4;
+        for (int f = 0; f < (counters ? 6 : 4) && valid; f++)
+            valid = (int) strlen(fields[f]) <= FIELD_LEN[f];
+        char fen[MAX_FEN_LEN];
+        if (valid) {
+            snprintf(fen, MAX_FEN_LEN, "%.71s %.1s %.4s %.2s %.6s %.6s", fields[0], fields[1], fields[2], fields[3],
+                    counters ? fields[4] : "0", counters ? fields[5] : "1");
+            valid = create_board(&check, fen);
+            free_board(&check);
+        }
+        if (!valid) {
+            fprintf(stderr, "%s:%d: skipping invalid position\n", path, line_number);
+            continue;
+        }
+
+        if (n == max) {
+            max *= 2;
+            *openings = (Opening*) realloc(*openings, max * sizeof(Opening));
+        }
+        Opening *opening = *openings + n++;
+        strcpy(opening->fen, fen);
+        opening->num_moves = 0;
+    }
+
+    fclose(fp);
+    return n;
+}
+
+
+static int random_openings(int count, int plies, unsigned int seed, Opening **openings)
+{
+    // Makes openings by playing `plies` random legal moves from the start,
+    // so the engines, which always play the same move in a position, don't
+    // repeat the same game.
+
+    *openings = (Opening*) malloc(count * sizeof(Opening));
+    if (plies > MAX_OPENING_MOVES)
+        plies = MAX_OPENING_MOVES;
+
+    for (int i = 0; i < count; i++) {
+        Opening *opening = *openings + i;
+        strcpy(opening->fen, START_FEN);
+        do {
+            Board board;
+            create_board(&board, START_FEN);
+            opening->num_moves = 0;
+            Move move;
+            while (opening->num_moves < plies && random_legal_move(&board, &seed, &move)) {
+                opening->moves[opening->num_moves++] = move;
+                play_move(move, &board);
+            }
+            update_winner(&board);
+            bool finished = board.winner != 0;
+            free_board(&board);
+            // Openings that end the game are thrown away.
+            if (!finished)
+                break;
+        } while (true);
+    }
+
+    return count;
+}
+
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-g games] [-a depth] [-b depth] [-o openings.epd | -r plies]\n", name);
+    fprintf(stderr, "          [-p out.pgn] [-k book.bin] [-t tbdir] [-s seed] [--net net.nnue]\n");
+    fprintf(stderr, "          [--elo0 elo] [--elo1 elo] [--alpha a] [--beta b] [--stats] [--stats-json file]\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Runs a match between two search depths, e.g.
+    //   ./selfplay -j 8 -g 2000 -a 3 -b 2 -r 8 -p games.pgn
+
+    enum { OPT_ELO0 = 256, OPT_ELO1, OPT_ALPHA, OPT_BETA, OPT_NET };
+    static const struct option LONG_OPTIONS[] = {
+        {"elo0", required_argument, NULL, OPT_ELO0},
+        {"elo1", required_argument, NULL, OPT_ELO1},
+        {"alpha", required_argument, NULL, OPT_ALPHA},
+        {"beta", required_argument, NULL, OPT_BETA},
+        {"net", required_argument, NULL, OPT_NET},
+        STAT_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+
+    Match match;
+    memset(&match, 0, sizeof(Match));
+    match.players[0].depth = SEARCH_DEPTH;
+    match.players[1].depth = SEARCH_DEPTH - 1;
+    match.num_games = 1000;
+    match.elo0 = 0;
+    match.elo1 = 10;
+    match.alpha = match.beta = 0.05;
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int random_plies = 8;
+    unsigned int seed = 1;
+    char *openings_path = NULL, *pgn_path = NULL;
+    bool show_stats = false;
+    char *stats_json = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:g:a:b:o:r:p:k:t:s:", LONG_OPTIONS, NULL)) != -1) {
+        switch (opt) {
+            case 'j': threads = atoi(optarg); break;
+            case 'g': match.num_games = atoi(optarg); break;
+            case 'a': match.players[0].depth = atoi(optarg); break;
+            case 'b': match.players[1].depth = atoi(optarg); break;
+            case 'o': openings_path = optarg; break;
+            case 'r': random_plies = atoi(optarg); break;
+            case 'p': pgn_path = optarg; break;
+            case 'k':
+                if (!open_book(&match.book, optarg))
+                    fprintf(stderr, "Could not open book %s\n", optarg);
+                break;
+            case 't':
+                if (load_tablebases(optarg) == 0)
+                    fprintf(stderr, "No tablebases found in %s\n", optarg);
+                break;
+            case 's': seed = atoi(optarg); break;
+            case OPT_ELO0: match.elo0 = atof(optarg); break;
+            case OPT_ELO1: match.elo1 = atof(optarg); break;
+            case OPT_ALPHA: match.alpha = atof(optarg); break;
+            case OPT_BETA: match.beta = atof(optarg); break;
+            case OPT_NET:
+                if (!load_network(optarg)) {
+                    fprintf(stderr, "Could not load network %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case STAT_OPTION_SUMMARY: show_stats = true; break;
+            case STAT_OPTION_JSON: stats_json = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || match.players[0].depth < 1 || match.players[1].depth < 1 ||
+            match.alpha <= 0 || match.beta <= 0 || match.alpha >= 1 || match.beta >= 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    srand(seed);
+
+    if (openings_path != NULL) {
+        match.num_openings = load_openings(openings_path, &match.openings);
+        if (match.num_openings <= 0) {
+            fprintf(stderr, "No openings in %s\n", openings_path);
+            return 1;
+        }
+    } else
+        match.num_openings = random_openings((match.num_games + 1) / 2, random_plies, seed, &match.openings);
+
+    if (pgn_path != NULL && (match.pgn = fopen(pgn_path, "w")) == NULL) {
+        perror(pgn_path);
+        return 1;
+    }
+
+    for (int i = 0; i < 2; i++)
+        snprintf(match.players[i].name, TAG_LEN, "%c depth %d", 'A' + i, match.players[i].depth);
+    fprintf(stderr, "%s vs %s, %d games on %d threads, SPRT elo0 %.1f elo1 %.1f alpha %.3f beta %.3f\n",
+            match.players[0].name, match.players[1].name, match.num_games, threads,
+            match.elo0, match.elo1, match.alpha, match.beta);
+
+    init_zobrist();
+    pthread_mutex_init(&match.lock, NULL);
+    pthread_t workers[MAX_THREADS];
+    for (int t = 0; t < threads; t++)
+        pthread_create(workers + t, NULL, match_worker, &match);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t], NULL);
+    pthread_mutex_destroy(&match.lock);
+
+    if (match.pgn != NULL)
+        fclose(match.pgn);
+    free(match.openings);
+    close_book(&match.book);
+    free_tablebases();
+    free_network();
+    report_stats(show_stats, stats_json);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * stats.c
+*/
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#if defined(STAT_CYCLES) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#include "stats.h"
+
+// Names used in both reports, indexed by Stat.
+static const char *STAT_NAMES[NUM_STATS] = {
+    "get_valid_moves", "verify_move", "in_check", "attacked_positions",
+    "make_move", "copy_board", "alloc", "attack_update", "legal_update",
+    "hash_board", "search_node", "book_probe", "book_hit", "tb_probe", "tb_hit",
+    "pawn_probe", "pawn_hit", "material_probe", "material_hit"
+};
+
+// Counts from threads that have called `flush_stats`.
+static StatCounters totals;
+
+#ifndef NO_STATS
+__thread StatCounters thread_stats;
+#endif
+
+
+#ifdef STAT_CYCLES
+unsigned long int read_cycles(void)
+{
+    // Returns the time stamp counter, or nanoseconds where there isn't one.
+
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+#endif
+
+
+void flush_stats(void)
+{
+    // Adds the calling thread's counts to the totals and clears them.
+    // Threads call this before they exit.
+
+#ifndef NO_STATS
+    for (int i = 0; i < NUM_STATS; i++) {
+        __atomic_fetch_add(totals.count + i, thread_stats.count[i], __ATOMIC_RELAXED);
+        __atomic_fetch_add(totals.cycles + i, thread_stats.cycles[i], __ATOMIC_RELAXED);
+    }
+    memset(&thread_stats, 0, sizeof(StatCounters));
+#endif
+}
+
+
+void reset_stats(void)
+{
+    // Clears the totals and the calling thread's counts.
+
+#ifndef NO_STATS
+    memset(&thread_stats, 0, sizeof(StatCounters));
+#endif
+    memset(&totals, 0, sizeof(StatCounters));
+}
+
+
+StatCounters total_stats(void)
+{
+    // Returns the totals, including the calling thread's counts.
+
+    flush_stats();
+    return totals;
+}
+
+
+static double hit_rate(StatCounters *stats, Stat hits, Stat probes)
+{
+    return stats->count[probes] ? 100.0 * stats->count[hits] / stats->count[probes] : 0.0;
+}
+
+
+void print_stats(FILE *fp)
+{
+    // Writes a table of the counters, for the --stats option.
+
+#ifdef NO_STATS
+    fprintf(fp, "stats: not available in release builds\n");
+#else
+    StatCounters stats = total_stats();
+    fprintf(fp, "%-20s %15s", "counter", "count");
+#ifdef STAT_CYCLES
+    fprintf(fp, " %15s %12s", "cycles", "cycles/call");
+#endif
+    fprintf(fp, "\n");
+
+    for (int i = 0; i < NUM_STATS; i++) {
+        fprintf(fp, "%-20s %15lu", STAT_NAMES[i], stats.count[i]);
+#ifdef STAT_CYCLES
+        if (stats.cycles[i])
+            fprintf(fp, " %15lu %12.1f", stats.cycles[i], (double) stats.cycles[i] / stats.count[i]);
+#endif
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "book hit rate        %14.1f%%\n", hit_rate(&stats, STAT_BOOK_HIT, STAT_BOOK_PROBE));
+    fprintf(fp, "tablebase hit rate   %14.1f%%\n", hit_rate(&stats, STAT_TB_HIT, STAT_TB_PROBE));
+    fprintf(fp, "pawn hash hit rate   %14.1f%%\n", hit_rate(&stats, STAT_PAWN_HIT, STAT_PAWN_PROBE));
+    fprintf(fp, "material hit rate    %14.1f%%\n", hit_rate(&stats, STAT_MATERIAL_HIT, STAT_MATERIAL_PROBE));
+#endif
+}
+
+
+void write_stats_json(FILE *fp)
+{
+    // Writes the counters as a single JSON object, for collecting from logs.
+
+#ifdef NO_STATS
+    fprintf(fp, "{\"enabled\": false}\n");
+#else
+    StatCounters stats = total_stats();
+#ifdef STAT_CYCLES
+    bool cycles = true;
+#else
+    bool cycles = false;
+#endif
+
+    fprintf(fp, "{\"enabled\": true, \"cycles\": %s, \"counters\": {", cycles ? "true" : "false");
+    for (int i = 0; i < NUM_STATS; i++) {
+        fprintf(fp, "%s\"%s\": {\"count\": %lu", i ? ", " : "", STAT_NAMES[i], stats.count[i]);
+        if (cycles)
+            fprintf(fp, ", \"cycles\": %lu", stats.cycles[i]);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "}}\n");
+#endif
+}
+
+
+void report_stats(bool summary, char *json_path)
+{
+    // Handles the --stats and --stats-json options at exit: the table goes
+    // to stderr and the JSON to `json_path` ("-" for stdout).
+
+    if (summary)
+        print_stats(stderr);
+    if (json_path == NULL)
+        return;
+
+    FILE *fp = (strcmp(json_path, "-") == 0) ? stdout : fopen(json_path, "w");
+    if (fp == NULL) {
+        perror(json_path);
+        return;
+    }
+    write_stats_json(fp);
+    if (fp != stdout)
+        fclose(fp);
+}
@@ -0,0 +1,97 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * stats.h
+*/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Counters for the hot paths of the rules, search and lookups. Each thread
+// counts into its own copy, so counting costs one increment and no
+// locking; `flush_stats` adds a thread's counts to the totals. Building
+// with -DNO_STATS (make RELEASE=1) removes them entirely, and
+// -DSTAT_CYCLES (make CYCLES=1) also times the functions marked with
+// STAT_TIME. Times include any calls to other timed functions.
+typedef enum {
+    STAT_GET_VALID_MOVES,
+    STAT_VERIFY_MOVE,
+    STAT_IN_CHECK,
+    STAT_ATTACKED_POSITIONS,
+    STAT_MAKE_MOVE,
+    STAT_COPY_BOARD,
+    STAT_ALLOC,
+    STAT_ATTACK_UPDATE,
+    STAT_LEGAL_UPDATE,
+    STAT_HASH_BOARD,
+    STAT_SEARCH_NODE,
+    STAT_BOOK_PROBE,
+    STAT_BOOK_HIT,
+    STAT_TB_PROBE,
+    STAT_TB_HIT,
+    STAT_PAWN_PROBE,
+    STAT_PAWN_HIT,
+    STAT_MATERIAL_PROBE,
+    STAT_MATERIAL_HIT,
+    NUM_STATS
+} Stat;
+
+typedef struct {
+    unsigned long int count[NUM_STATS];
+    unsigned long int cycles[NUM_STATS];
+} StatCounters;
+
+#ifndef NO_STATS
+
+extern __thread StatCounters thread_stats;
+
+#define STAT_INC(stat) (thread_stats.count[stat]++)
+#define STAT_ADD(stat, n) (thread_stats.count[stat] += (n))
+
+#ifdef STAT_CYCLES
+unsigned long int read_cycles(void);
+
+typedef struct {
+    Stat stat;
+    unsigned long int start;
+} StatTimer;
+
+static inline void stop_stat_timer(StatTimer *timer)
+{
+    thread_stats.cycles[timer->stat] += read_cycles() - timer->start;
+}
+
+// Counts a call and times it until the end of the enclosing block.
+#define STAT_TIME(stat) \
+    StatTimer stat_timer __attribute__((cleanup(stop_stat_timer))) = {stat, (STAT_INC(stat), read_cycles())}
+#else
+#define STAT_TIME(stat) STAT_INC(stat)
+#endif
+
+#else
+
+#define STAT_INC(stat) ((void) 0)
+#define STAT_ADD(stat, n) ((void) 0)
+#define STAT_TIME(stat) ((void) 0)
+
+#endif
+
+// getopt_long entries for the --stats and --stats-json options, which
+// the command line tools hand to `report_stats`.
+#define STAT_OPTION_SUMMARY ('S')
+#define STAT_OPTION_JSON ('J')
+#define STAT_LONG_OPTIONS \
+    {"stats", no_argument, NULL, STAT_OPTION_SUMMARY}, \
+    {"stats-json", required_argument, NULL, STAT_OPTION_JSON}
+
+
+void flush_stats(void);
+void reset_stats(void);
+StatCounters total_stats(void);
+void print_stats(FILE *fp);
+void write_stats_json(FILE *fp);
+void report_stats(bool summary, char *json_path);
+
+#endif
@@ -0,0 +1,355 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * tablebase.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chessfunc.h"
+#include "tablebase.h"
+
+
+// Order that a side's pieces are listed in, strongest first.
+static const char *TB_PIECE_ORDER = "KQRBN";
+static const int TB_PIECE_VALUES[] = {0, 9, 5, 3, 3};
+static const PieceType TB_PIECE_TYPES[] = {KING, QUEEN, ROOK, BISHOP, KNIGHT};
+
+// Squares of the a1-d1-d4 triangle. Pawnless positions have eight
+// symmetries, and one of them always puts the white king in here.
+static const Pos TRIANGLE_SQUARES[TB_KING_SQUARES] = {56, 57, 58, 59, 49, 50, 51, 42, 43, 35};
+
+static Tablebase TABLES[TB_MAX_TABLES];
+static int num_tables = 0;
+
+
+static int triangle_index(Pos pos)
+{
+    // Returns the index of `pos` within the triangle, or -1.
+
+    for (int i = 0; i < TB_KING_SQUARES; i++) {
+        if (TRIANGLE_SQUARES[i] == pos)
+            return i;
+    }
+    return -1;
+}
+
+
+static void sort_side(char *side)
+{
+    // Sorts a side's non-king pieces strongest first.
+
+    int n = strlen(side);
+    for (int i = 2; i < n; i++) {
+        for (int j = i; j > 1 && strchr(TB_PIECE_ORDER, side[j]) < strchr(TB_PIECE_ORDER, side[j - 1]); j--) {
+            char tmp = side[j];
+            side[j] = side[j - 1];
+            side[j - 1] = tmp;
+        }
+    }
+}
+
+
+static int side_strength(char *side)
+{
+    // Adds up the value of a side's pieces.
+
+    int total = 0;
+    for (; *side; side++)
+        total += TB_PIECE_VALUES[strchr(TB_PIECE_ORDER, *side) - TB_PIECE_ORDER];
+    return total;
+}
+
+
+bool parse_material(char *material, Tablebase *tb)
+{
+    // Fills in the piece layout of `tb` from a material string such as
+    // "KQKR". The stronger side is always stored as white.
+
+    int n = strlen(material);
+    char *black = strchr(material + 1, 'K');
+    if (n < 2 || n > TB_MAX_PIECES || material[0] != 'K' || black == NULL)
+        return false;
+    if (strchr(black + 1, 'K') != NULL)
+        return false;
+    for (int i = 0; i < n; i++) {
+        if (strchr(TB_PIECE_ORDER, material[i]) == NULL)
+            return false;
+    }
+
+    char white_str[TB_MAX_PIECES + 1], black_str[TB_MAX_PIECES + 1];
+    strncpy(white_str, material, black - material);
+    white_str[black - material] = '\0';
+    strcpy(black_str, black);
+    sort_side(white_str);
+    sort_side(black_str);
+
+    // Keep the stronger side as white, so "KRKQ" and "KQKR" share a table.
+    int diff = side_strength(white_str) - side_strength(black_str);
+    if (diff < 0 || (diff == 0 && strcmp(white_str, black_str) > 0)) {
+        char tmp[TB_MAX_PIECES + 1];
+        strcpy(tmp, white_str);
+        strcpy(white_str, black_str);
+        strcpy(black_str, tmp);
+    }
+
+    strcpy(tb->material, white_str);
+    strcat(tb->material, black_str);
+    tb->num_pieces = n;
+    int white_count = strlen(white_str);
+    for (int i = 0; i < n; i++) {
+        PieceType type = TB_PIECE_TYPES[strchr(TB_PIECE_ORDER, tb->material[i]) - TB_PIECE_ORDER];
+        tb->pieces[i] = type | ((i < white_count) ? WHITE : BLACK);
+    }
+
+    // The white king has 10 squares, every other piece 64.
+    tb->entries = TB_KING_SQUARES;
+    for (int i = 1; i < n; i++)
+        tb->entries *= BOARD_DIM * BOARD_DIM;
+
+    return true;
+}
+
+
+unsigned long int tb_encode(Pos *squares, Tablebase *tb)
+{
+    // Returns the index of the piece squares. The white king must be in
+    // the triangle.
+
+    unsigned long int index = triangle_index(squares[0]);
+    for (int i = 1; i < tb->num_pieces; i++)
+        index = index * BOARD_DIM * BOARD_DIM + squares[i];
+    return index;
+}
+
+
+void tb_decode(unsigned long int index, Pos *squares, Tablebase *tb)
+{
+    // Reverses `tb_encode`.
+
+    for (int i = tb->num_pieces - 1; i > 0; i--) {
+        squares[i] = index % (BOARD_DIM * BOARD_DIM);
+        index /= BOARD_DIM * BOARD_DIM;
+    }
+    squares[0] = TRIANGLE_SQUARES[index];
+}
+
+
+void tb_transform(Pos *dest, Pos *squares, int symmetry, Tablebase *tb)
+{
+    // Applies one of the eight board symmetries to the piece squares.
+    // Bit 0 mirrors the files, bit 1 the ranks, and bit 2 the diagonal.
+    // Identical pieces are then sorted so each position has one layout.
+
+    for (int i = 0; i < tb->num_pieces; i++) {
+        int x = squares[i] % BOARD_DIM, y = squares[i] / BOARD_DIM;
+        if (symmetry & 1) x = BOARD_DIM - 1 - x;
+        if (symmetry & 2) y = BOARD_DIM - 1 - y;
+        if (symmetry & 4) {
+            int tmp = x;
+            x = y;
+            y = tmp;
+        }
+        dest[i] = x + BOARD_DIM * y;
+    }
+
+    for (int i = 1; i < tb->num_pieces; i++) {
+        for (int j = i; j > 0 && tb->pieces[j] == tb->pieces[j - 1] && dest[j] < dest[j - 1]; j--) {
+            Pos tmp = dest[j];
+            dest[j] = dest[j - 1];
+            dest[j - 1] = tmp;
+        }
+    }
+}
+
+
+unsigned long int tb_canonical_index(Pos *squares, Tablebase *tb)
+{
+    // Returns the smallest index among the symmetric copies of a position,
+    // so every position is stored exactly once.
+
+    unsigned long int best = tb->entries;
+    Pos tmp[TB_MAX_PIECES];
+    for (int s = 0; s < 8; s++) {
+        tb_transform(tmp, squares, s, tb);
+        if (triangle_index(tmp[0]) < 0)
+            continue;
+        unsigned long int index = tb_encode(tmp, tb);
+        if (index < best)
+            best = index;
+    }
+    return best;
+}
+
+
+unsigned long int tb_packed_size(unsigned long int entries, unsigned int bits)
+{
+    // Bytes used by one side's packed values. Padding leaves room for the
+    // 8 byte reads in `tb_value` and keeps the next section aligned.
+
+    return ((entries * bits + 7) / 8 + 15) / 8 * 8;
+}
+
+
+int tb_value(Tablebase *tb, int turn, unsigned long int index)
+{
+    // Unpacks the value stored for `index` with color index `turn` to move.
+
+    unsigned long int bit = index * tb->bits;
+    unsigned long int word;
+    memcpy(&word, tb->data[turn] + bit / 8, sizeof(word));
+    return (word >> (bit % 8)) & ((1UL << tb->bits) - 1);
+}
+
+
+bool load_tablebase(char *path)
+{
+    // Maps the tablebase file at `path` into memory and makes it available
+    // to `probe_tablebase`. Nothing is read until a probe touches it.
+
+    if (num_tables == TB_MAX_TABLES)
+        return false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(TablebaseHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    TablebaseHeader *header = (TablebaseHeader*) map;
+    Tablebase *tb = TABLES + num_tables;
+    char material[sizeof(header->material) + 1] = {0};
+    memcpy(material, header->material, sizeof(header->material));
+    if (memcmp(header->magic, TB_MAGIC, sizeof(header->magic)) != 0 || !parse_material(material, tb) ||
+            tb->entries != header->entries || header->bits == 0 || header->bits > 8 ||
+            st.st_size < (off_t) (sizeof(TablebaseHeader) + 2 * tb_packed_size(tb->entries, header->bits))) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    // A table that is already loaded is kept.
+    for (int i = 0; i < num_tables; i++) {
+        if (strcmp(TABLES[i].material, tb->material) == 0) {
+            munmap(map, st.st_size);
+            return true;
+        }
+    }
+
+    tb->bits = header->bits;
+    tb->map = map;
+    tb->size = st.st_size;
+    tb->data[0] = (unsigned char*) map + sizeof(TablebaseHeader);
+    tb->data[1] = tb->data[0] + tb_packed_size(tb->entries, tb->bits);
+    num_tables++;
+    return true;
+}
+
+
+int load_tablebases(char *dir)
+{
+    // Loads every ".tb" file in `dir` and returns how many were loaded.
+
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return 0;
+
+    int loaded = 0;
+    struct dirent *entry;
+    char path[1024];
+    while ((entry = readdir(d)) != NULL) {
+        int len = strlen(entry->d_name);
+        if (len < 4 || strcmp(entry->d_name + len - 3, ".tb") != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (load_tablebase(path))
+            loaded++;
+    }
+
+    closedir(d);
+    return loaded;
+}
+
+
+void free_tablebases(void)
+{
+    // Unmaps every loaded tablebase.
+
+    for (int i = 0; i < num_tables; i++)
+        munmap(TABLES[i].map, TABLES[i].size);
+    num_tables = 0;
+}
+
+
+int probe_tablebase(Board *board)
+{
+    // Looks the position up in the loaded tablebases. See tablebase.h for
+    // the meaning of the returned value.
+
+    Piece found[TB_MAX_PIECES];
+    Pos where[TB_MAX_PIECES];
+    int n = 0;
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        Piece p = *(board->arr + i);
+        if (p == 0)
+            continue;
+        if (n == TB_MAX_PIECES || (p & PIECE_BITMASK) == PAWN)
+            return TB_UNKNOWN;
+        found[n] = p & (PIECE_BITMASK | COLOR_BITMASK);
+        where[n++] = i;
+    }
+
+    // Two bare kings can never mate.
+    if (n == 2)
+        return 0;
+
+    // Try the position as it is, then with the colors swapped, which is a
+    // symmetry when there are no pawns.
+    for (int swap = 0; swap < 2; swap++) {
+        for (int t = 0; t < num_tables; t++) {
+            Tablebase *tb = TABLES + t;
+            if (tb->num_pieces != n)
+                continue;
+
+            Pos squares[TB_MAX_PIECES];
+            bool used[TB_MAX_PIECES] = {false};
+            bool match = true;
+            for (int j = 0; j < n && match; j++) {
+                Piece want = tb->pieces[j];
+                if (swap)
+                    want = (want & PIECE_BITMASK) | (((want & COLOR_BITMASK) == WHITE) ? BLACK : WHITE);
+                match = false;
+                for (int k = 0; k < n; k++) {
+                    if (!used[k] && found[k] == want) {
+                        used[k] = true;
+                        squares[j] = where[k];
+                        match = true;
+                        break;
+                    }
+                }
+            }
+            if (!match)
+                continue;
+
+            int turn = board->turn;
+            if (swap)
+                turn = (turn == WHITE) ? BLACK : WHITE;
+            return tb_value(tb, COLOR_INDEX(turn), tb_canonical_index(squares, tb));
+        }
+    }
+
+    return TB_UNKNOWN;
+}
@@ -0,0 +1,67 @@
+/* 
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * tablebase.h
+*/
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chessfunc.h"
+
+// Endgame tablebases store the distance to mate of every position with a
+// given set of pieces. Tables are indexed with the white king folded into
+// the a1-d1-d4 triangle, which relies on the eight symmetries of pawnless
+// positions, so only pawnless endings of up to TB_MAX_PIECES pieces have
+// tables.
+// https://www.chessprogramming.org/Endgame_Tablebases
+#define TB_MAX_PIECES (4)
+#define TB_MAX_TABLES (64)
+#define TB_KING_SQUARES (10)
+#define TB_MAGIC "CPTB0001"
+
+// A probe returns TB_UNKNOWN for positions without a table, otherwise a
+// value `v`: 0 is a draw, and `v - 1` is the number of half-moves until
+// mate. The side to move wins when that number is odd.
+#define TB_UNKNOWN (-1)
+#define TB_WINS(v) ((v) > 0 && (v) % 2 == 0)
+#define TB_LOSES(v) ((v) > 0 && (v) % 2 == 1)
+#define TB_PLIES(v) ((v) - 1)
+
+// Every file starts with this header, followed by the bit-packed values
+// for white to move and then for black to move.
+typedef struct {
+    char magic[8];
+    char material[8];
+    unsigned long int entries;
+    unsigned int bits;
+    unsigned int reserved;
+} TablebaseHeader;
+
+typedef struct {
+    char material[TB_MAX_PIECES + 1];       // e.g. "KQKR": white's pieces, then black's.
+    int num_pieces;
+    Piece pieces[TB_MAX_PIECES];            // Piece of each index slot; slot 0 is the white king.
+    unsigned long int entries;              // Positions per side to move.
+    unsigned int bits;                      // Bits used per packed value.
+    const unsigned char *data[2];           // Packed values, indexed by COLOR_INDEX of the turn.
+    void *map;
+    size_t size;
+} Tablebase;
+
+
+bool parse_material(char *material, Tablebase *tb);
+unsigned long int tb_encode(Pos *squares, Tablebase *tb);
+void tb_decode(unsigned long int index, Pos *squares, Tablebase *tb);
+unsigned long int tb_canonical_index(Pos *squares, Tablebase *tb);
+void tb_transform(Pos *dest, Pos *squares, int symmetry, Tablebase *tb);
+unsigned long int tb_packed_size(unsigned long int entries, unsigned int bits);
+int tb_value(Tablebase *tb, int turn, unsigned long int index);
+bool load_tablebase(char *path);
+int load_tablebases(char *dir);
+void free_tablebases(void);
+int probe_tablebase(Board *board);
+
+#endif
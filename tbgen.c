@@ -0,0 +1,485 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * tbgen.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "chessfunc.h"
+#include "tablebase.h"
+#include "stats.h"
+
+// Marks entries that aren't legal positions, or are symmetric copies of
+// another entry, in the `count` array.
+#define INVALID (255)
+// Marks positions that can't be lost because a capture avoids it.
+#define CANT_LOSE (255)
+#define MAX_THREADS (256)
+
+
+// State shared by the worker threads while a table is generated.
+typedef struct {
+    Tablebase *tb;
+    unsigned char *value[2];        // Same encoding as the finished table; 0 is still unknown.
+    unsigned char *count[2];        // Moves (other than captures) not yet known to lose.
+    unsigned char *loss_floor[2];   // Plies until mate after the slowest losing capture.
+    int level;
+    int max_value;
+    bool failed;
+} Generator;
+
+// A slice of one side's positions handed to a worker thread.
+typedef struct {
+    Generator *gen;
+    int turn;
+    unsigned long int start, end;
+} Job;
+
+
+static int num_threads = 1;
+static char *out_dir = ".";
+
+
+static void raise_max_value(Generator *gen, int value)
+{
+    // Records the largest value assigned so far, which tells the main loop
+    // how many levels remain.
+
+    int curr = __atomic_load_n(&gen->max_value, __ATOMIC_RELAXED);
+    while (value > curr && !__atomic_compare_exchange_n(&gen->max_value, &curr, value, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+static void setup_board(Board *board, Pos *squares, int turn, Tablebase *tb)
+{
+    // Places the table's pieces on `board`. Every piece is marked as moved
+    // so castling never comes up.
+
+    memset(board->arr, 0, BOARD_DIM * BOARD_DIM * sizeof(Piece));
+    for (int i = 0; i < tb->num_pieces; i++) {
+        *(board->arr + squares[i]) = tb->pieces[i] | MOVED;
+        if ((tb->pieces[i] & PIECE_BITMASK) == KING)
+            board->kings[COLOR_INDEX(tb->pieces[i] & COLOR_BITMASK)] = squares[i];
+    }
+    board->turn = turn;
+    board->winner = 0;
+    board->ep_target_pos = 64;
+    board->half_move_clock = 0;
+    board->move_count = 1;
+    if (board->attacks != NULL)
+        init_attack_map(board);
+}
+
+
+static void init_job_board(Board *board, bool with_attacks)
+{
+    // Allocates a scratch board for a worker thread. Its pieces are placed
+    // by `setup_board` for each position, so there's no FEN to read.
+
+    board->arr = (Piece*) calloc(BOARD_DIM * BOARD_DIM, sizeof(Piece));
+    board->highlights = NULL;
+    board->legal_moves = NULL;
+    board->num_legal_moves = 0;
+    board->attacks = with_attacks ? (AttackMap*) malloc(sizeof(AttackMap)) : NULL;
+    board->accumulator = NULL;
+    // Tablebase positions are never evaluated, so the keys aren't kept.
+    board->pawn_key = board->material_key = 0;
+}
+
+
+static void *init_positions(void *arg)
+{
+    // Plays every legal move of each position once. Captures are looked up
+    // in the smaller tables, checkmates are scored, and the remaining moves
+    // are counted for the retrograde passes.
+
+    Job *job = (Job*) arg;
+    Generator *gen = job->gen;
+    Tablebase *tb = gen->tb;
+    int turn = job->turn ? BLACK : WHITE;
+    int opp = job->turn ? WHITE : BLACK;
+
+    Board board;
+    init_job_board(&board, true);
+    Pos squares[TB_MAX_PIECES];
+
+    for (unsigned long int index = job->start; index < job->end; index++) {
+        gen->value[job->turn][index] = 0;
+        gen->count[job->turn][index] = INVALID;
+        gen->loss_floor[job->turn][index] = CANT_LOSE;
+
+        tb_decode(index, squares, tb);
+        bool overlap = false;
+        for (int i = 0; i < tb->num_pieces; i++) {
+            for (int j = 0; j < i; j++)
+                overlap |= squares[i] == squares[j];
+        }
+        // Symmetric copies are skipped so each position is solved once.
+        if (overlap || tb_canonical_index(squares, tb) != index)
+            continue;
+
+        setup_board(&board, squares, turn, tb);
+        // The side that just moved can't have left its king in check.
+        if (in_check(&board) & opp)
+            continue;
+
+        int moves = 0, children = 0;
+        int best_win = INVALID, slowest_loss = 0;
+        bool can_lose = true;
+        for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+            if ((*(board.arr + i) & COLOR_BITMASK) != turn)
+                continue;
+            Bitboard targets = (Bitboard) 0;
+            V2Int from = {i % BOARD_DIM, i / BOARD_DIM};
+            get_valid_moves(from, &targets, &board, true);
+
+            for (; targets; targets &= targets - 1) {
+                int j = __builtin_ctzl(targets);
+                moves++;
+                if (*(board.arr + j) == 0) {
+                    children++;
+                    continue;
+                }
+
+                // Captures leave this table, so their result is already known.
+                Board child;
+                copy_board(&child, &board);
+                make_move(from, (V2Int) {j % BOARD_DIM, j / BOARD_DIM}, &child);
+                int v = probe_tablebase(&child);
+                free_board(&child);
+
+                if (v == TB_UNKNOWN) {
+                    gen->failed = true;
+                } else if (TB_LOSES(v)) {
+                    can_lose = false;
+                    if (TB_PLIES(v) + 1 < best_win)
+                        best_win = TB_PLIES(v) + 1;
+                } else if (TB_WINS(v)) {
+                    if (TB_PLIES(v) + 1 > slowest_loss)
+                        slowest_loss = TB_PLIES(v) + 1;
+                } else
+                    can_lose = false;
+            }
+        }
+
+        gen->count[job->turn][index] = children;
+        if (moves == 0) {
+            // Checkmate is a loss in 0 plies, stalemate stays a draw.
+            if (in_check(&board) & turn) {
+                gen->value[job->turn][index] = 1;
+                raise_max_value(gen, 1);
+            }
+            continue;
+        }
+
+        if (can_lose)
+            gen->loss_floor[job->turn][index] = slowest_loss;
+        // A winning capture is only an upper bound; a quicker quiet win may
+        // still be found by the retrograde passes.
+        if (best_win != INVALID)
+            gen->value[job->turn][index] = best_win + 1;
+        else if (children == 0 && can_lose)
+            gen->value[job->turn][index] = slowest_loss + 1;
+        if (gen->value[job->turn][index] != 0)
+            raise_max_value(gen, gen->value[job->turn][index]);
+    }
+
+    free_board(&board);
+    flush_stats();
+    return NULL;
+}
+
+
+static void *retrograde_pass(void *arg)
+{
+    // Takes every position decided at the current level and walks its
+    // moves backwards. If it is lost, each predecessor is won one ply
+    // later. If it is won, each predecessor has one fewer escape, and when
+    // none remain that predecessor is lost.
+
+    Job *job = (Job*) arg;
+    Generator *gen = job->gen;
+    Tablebase *tb = gen->tb;
+    int level = gen->level;
+    // The previous move was made by the other side.
+    int prev = job->turn ? WHITE : BLACK;
+    int prev_i = COLOR_INDEX(prev);
+
+    Board board;
+    init_job_board(&board, false);
+    Pos squares[TB_MAX_PIECES], orbit[8][TB_MAX_PIECES], pred[TB_MAX_PIECES];
+
+    for (unsigned long int index = job->start; index < job->end; index++) {
+        if (gen->value[job->turn][index] != level + 1 || gen->count[job->turn][index] == INVALID)
+            continue;
+
+        // Moves into any symmetric copy of this position lead here, so
+        // every distinct copy is walked back.
+        tb_decode(index, squares, tb);
+        int orbit_size = 0;
+        for (int s = 0; s < 8; s++) {
+            tb_transform(orbit[orbit_size], squares, s, tb);
+            bool seen = false;
+            for (int k = 0; k < orbit_size && !seen; k++)
+                seen = memcmp(orbit[k], orbit[orbit_size], tb->num_pieces * sizeof(Pos)) == 0;
+            if (!seen)
+                orbit_size++;
+        }
+
+        for (int o = 0; o < orbit_size; o++) {
+            setup_board(&board, orbit[o], job->turn ? BLACK : WHITE, tb);
+            Bitboard occupied = (Bitboard) 0;
+            for (int k = 0; k < tb->num_pieces; k++)
+                update_bitboard(&occupied, orbit[o][k]);
+
+            for (int k = 0; k < tb->num_pieces; k++) {
+                if ((tb->pieces[k] & COLOR_BITMASK) != prev)
+                    continue;
+                // Without pawns, a piece could have come from any empty
+                // square it attacks.
+                Bitboard origins = piece_attacks(orbit[o][k], &board) & ~occupied;
+                for (; origins; origins &= origins - 1) {
+                    memcpy(pred, orbit[o], sizeof(pred));
+                    pred[k] = __builtin_ctzl(origins);
+                    tb_transform(pred, pred, 0, tb);
+
+                    // Only the stored copy of the predecessor is updated.
+                    unsigned long int p_index = tb_canonical_index(pred, tb);
+                    if (p_index == tb->entries || p_index != tb_encode(pred, tb))
+                        continue;
+                    if (gen->count[prev_i][p_index] == INVALID)
+                        continue;
+
+                    unsigned char *value = gen->value[prev_i] + p_index;
+                    if (level % 2 == 0) {
+                        unsigned char curr = __atomic_load_n(value, __ATOMIC_RELAXED);
+                        while (curr == 0 || curr > level + 2) {
+                            if (__atomic_compare_exchange_n(value, &curr, level + 2, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                                raise_max_value(gen, level + 2);
+                                break;
+                            }
+                        }
+                    } else if (__atomic_sub_fetch(gen->count[prev_i] + p_index, 1, __ATOMIC_RELAXED) == 0 &&
+                            gen->loss_floor[prev_i][p_index] != CANT_LOSE && *value == 0) {
+                        int plies = level + 1;
+                        if (gen->loss_floor[prev_i][p_index] > plies)
+                            plies = gen->loss_floor[prev_i][p_index];
+                        if (plies + 1 >= INVALID)
+                            gen->failed = true;
+                        *value = plies + 1;
+                        raise_max_value(gen, plies + 1);
+                    }
+                }
+            }
+        }
+    }
+
+    free_board(&board);
+    flush_stats();
+    return NULL;
+}
+
+
+static void run_parallel(Generator *gen, void *(*func)(void*))
+{
+    // Runs `func` over all positions, one side to move at a time, with the
+    // positions split evenly between the worker threads.
+
+    pthread_t threads[MAX_THREADS];
+    Job jobs[MAX_THREADS];
+    unsigned long int entries = gen->tb->entries;
+
+    for (int turn = 0; turn < 2; turn++) {
+        for (int t = 0; t < num_threads; t++) {
+            jobs[t] = (Job) {gen, turn, entries * t / num_threads, entries * (t + 1) / num_threads};
+            pthread_create(threads + t, NULL, func, jobs + t);
+        }
+        for (int t = 0; t < num_threads; t++)
+            pthread_join(threads[t], NULL);
+    }
+}
+
+
+static bool write_table(Generator *gen, char *path)
+{
+    // Bit-packs the values with as few bits as the longest mate needs and
+    // writes them after the header.
+
+    Tablebase *tb = gen->tb;
+    TablebaseHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TB_MAGIC, sizeof(header.magic));
+    strncpy(header.material, tb->material, sizeof(header.material));
+    header.entries = tb->entries;
+    header.bits = 1;
+    while ((1 << header.bits) <= gen->max_value)
+        header.bits++;
+
+    // Write to a temporary file first so a table that is already mapped
+    // isn't changed underneath a reader.
+    char tmp_path[1100];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL)
+        return false;
+    fwrite(&header, sizeof(header), 1, fp);
+
+    unsigned long int size = tb_packed_size(tb->entries, header.bits);
+    unsigned char *packed = (unsigned char*) malloc(size);
+    for (int turn = 0; turn < 2; turn++) {
+        memset(packed, 0, size);
+        for (unsigned long int i = 0; i < tb->entries; i++) {
+            unsigned long int v = (gen->count[turn][i] == INVALID) ? 0 : gen->value[turn][i];
+            unsigned long int bit = i * header.bits, word;
+            memcpy(&word, packed + bit / 8, sizeof(word));
+            word |= v << (bit % 8);
+            memcpy(packed + bit / 8, &word, sizeof(word));
+        }
+        fwrite(packed, 1, size, fp);
+    }
+    free(packed);
+
+    bool ok = (fclose(fp) == 0);
+    return ok && rename(tmp_path, path) == 0;
+}
+
+
+static void print_summary(Generator *gen, double seconds)
+{
+    // Prints how the positions of a finished table were decided.
+
+    unsigned long int wins = 0, losses = 0, draws = 0;
+    for (int turn = 0; turn < 2; turn++) {
+        for (unsigned long int i = 0; i < gen->tb->entries; i++) {
+            int v = gen->value[turn][i];
+            if (gen->count[turn][i] == INVALID)
+                continue;
+            if (TB_WINS(v)) wins++;
+            else if (TB_LOSES(v)) losses++;
+            else draws++;
+        }
+    }
+
+    printf("%s: %lu positions, %lu wins, %lu losses, %lu draws, longest mate %d plies, %.1fs\n",
+            gen->tb->material, wins + losses + draws, wins, losses, draws,
+            gen->max_value > 0 ? gen->max_value - 1 : 0, seconds);
+}
+
+
+static bool generate(char *material)
+{
+    // Generates the table for `material`, first generating any table it can
+    // reach by a capture. Tables that already exist in `out_dir` are loaded
+    // instead of being generated again.
+
+    Tablebase *tb = (Tablebase*) malloc(sizeof(Tablebase));
+    if (!parse_material(material, tb)) {
+        fprintf(stderr, "Invalid material %s\n", material);
+        free(tb);
+        return false;
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.tb", out_dir, tb->material);
+    if (load_tablebase(path)) {
+        free(tb);
+        return true;
+    }
+
+    // Removing any piece other than a king gives a smaller table.
+    for (int i = 1; i < tb->num_pieces && tb->num_pieces > 3; i++) {
+        if (tb->material[i] == 'K')
+            continue;
+        char sub[TB_MAX_PIECES + 1];
+        strcpy(sub, tb->material);
+        memmove(sub + i, sub + i + 1, strlen(sub + i));
+        if (!generate(sub)) {
+            free(tb);
+            return false;
+        }
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Generator gen = {.tb = tb};
+    for (int turn = 0; turn < 2; turn++) {
+        gen.value[turn] = (unsigned char*) malloc(tb->entries);
+        gen.count[turn] = (unsigned char*) malloc(tb->entries);
+        gen.loss_floor[turn] = (unsigned char*) malloc(tb->entries);
+    }
+
+    run_parallel(&gen, init_positions);
+    for (gen.level = 0; gen.level + 1 <= gen.max_value && !gen.failed; gen.level++)
+        run_parallel(&gen, retrograde_pass);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bool ok = !gen.failed;
+    if (ok) {
+        print_summary(&gen, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+        ok = write_table(&gen, path) && load_tablebase(path);
+    }
+    if (!ok)
+        fprintf(stderr, "Failed to generate %s\n", tb->material);
+
+    for (int turn = 0; turn < 2; turn++) {
+        free(gen.value[turn]);
+        free(gen.count[turn]);
+        free(gen.loss_floor[turn]);
+    }
+    free(tb);
+    return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Generates the tablebases named on the command line, e.g.
+    //   ./tbgen -j 8 -d tables KQK KRK KQKR
+
+    static const struct option LONG_OPTIONS[] = {STAT_LONG_OPTIONS, {NULL, 0, NULL, 0}};
+    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool show_stats = false;
+    char *stats_json = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:d:", LONG_OPTIONS, NULL)) != -1) {
+        if (opt == 'j')
+            num_threads = atoi(optarg);
+        else if (opt == 'd')
+            out_dir = optarg;
+        else if (opt == STAT_OPTION_SUMMARY)
+            show_stats = true;
+        else if (opt == STAT_OPTION_JSON)
+            stats_json = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-j threads] [-d dir] [--stats] [--stats-json file] MATERIAL...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+
+    if (optind == argc) {
+        fprintf(stderr, "usage: %s [-j threads] [-d dir] [--stats] [--stats-json file] MATERIAL...\n", argv[0]);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!generate(argv[i]))
+            status = 1;
+    }
+
+    free_tablebases();
+    report_stats(show_stats, stats_json);
+    return status;
+}
@@ -0,0 +1,93 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * training.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "chessfunc.h"
+#include "training.h"
+
+// Piece letters by nibble: white pieces, then black pieces.
+static const char *NIBBLE_STR = " PNBRQK  pnbrqk ";
+
+
+void pack_record(Board *board, int score, int result, TrainingRecord *record)
+{
+    // Stores the position on `board` with its score for the side to move
+    // and the game's result from white's point of view.
+
+    memset(record->squares, 0, sizeof(record->squares));
+    for (int i = 0; i < BOARD_DIM * BOARD_DIM; i++) {
+        Piece p = *(board->arr + i);
+        if (p == 0)
+            continue;
+        int nibble = (p & PIECE_BITMASK) | (((p & COLOR_BITMASK) == BLACK) ? 8 : 0);
+        record->squares[i / 2] |= nibble << (4 * (i % 2));
+    }
+
+    if (score > TRAINING_SCORE_MAX)
+        score = TRAINING_SCORE_MAX;
+    if (score < -TRAINING_SCORE_MAX)
+        score = -TRAINING_SCORE_MAX;
+    record->score = score;
+    record->result = result;
+
+    record->flags = (board->turn == BLACK) ? TRAINING_BLACK_TO_MOVE : 0;
+    if (can_castle(60, 63, WHITE, board)) record->flags |= TRAINING_WHITE_SHORT;
+    if (can_castle(60, 56, WHITE, board)) record->flags |= TRAINING_WHITE_LONG;
+    if (can_castle(4, 7, BLACK, board)) record->flags |= TRAINING_BLACK_SHORT;
+    if (can_castle(4, 0, BLACK, board)) record->flags |= TRAINING_BLACK_LONG;
+
+    record->ep_square = board->ep_target_pos;
+    record->half_move_clock = (board->half_move_clock > 255) ? 255 : board->half_move_clock;
+    record->move_count = board->move_count;
+}
+
+
+void record_to_FEN(TrainingRecord *record, char *fen)
+{
+    // Writes the position stored in `record` as a FEN string into `fen`,
+    // which must hold at least 100 characters.
+
+    char *out = fen;
+    for (int rank = 0; rank < BOARD_DIM; rank++) {
+        int empty = 0;
+        for (int file = 0; file < BOARD_DIM; file++) {
+            int i = rank * BOARD_DIM + file;
+            int nibble = (record->squares[i / 2] >> (4 * (i % 2))) & 15;
+            if (nibble == 0) {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+                *(out++) = '0' + empty;
+            empty = 0;
+            *(out++) = NIBBLE_STR[nibble];
+        }
+        if (empty > 0)
+            *(out++) = '0' + empty;
+        if (rank < BOARD_DIM - 1)
+            *(out++) = '/';
+    }
+
+    *(out++) = ' ';
+    *(out++) = (record->flags & TRAINING_BLACK_TO_MOVE) ? 'b' : 'w';
+    *(out++) = ' ';
+    if (record->flags & TRAINING_WHITE_SHORT) *(out++) = 'K';
+    if (record->flags & TRAINING_WHITE_LONG) *(out++) = 'Q';
+    if (record->flags & TRAINING_BLACK_SHORT) *(out++) = 'k';
+    if (record->flags & TRAINING_BLACK_LONG) *(out++) = 'q';
+    if (out[-1] == ' ')
+        *(out++) = '-';
+    *(out++) = ' ';
+    if (record->ep_square < BOARD_DIM * BOARD_DIM) {
+        *(out++) = 'a' + record->ep_square % BOARD_DIM;
+        *(out++) = '0' + BOARD_DIM - record->ep_square / BOARD_DIM;
+    } else
+        *(out++) = '-';
+    sprintf(out, " %d %d", record->half_move_clock, record->move_count);
+}
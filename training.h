@@ -0,0 +1,42 @@
+/*
+ * Jack O'Connor
+ * Fund Comp Lab 11
+ * training.h
+*/
+#ifndef TRAINING_H
+#define TRAINING_H
+
+#include "chessfunc.h"
+
+// Training data for evaluation functions is a flat file of fixed size
+// records, one per position, with no header, so files can be appended to,
+// concatenated, shuffled and split without parsing them. Each record holds
+// the position, a search score and the result of the game it came from.
+#define TRAINING_SCORE_MAX (32000)      // Scores are clamped to this; mates score it exactly.
+
+// Bits of `TrainingRecord.flags`.
+#define TRAINING_BLACK_TO_MOVE (1)
+#define TRAINING_WHITE_SHORT (2)
+#define TRAINING_WHITE_LONG (4)
+#define TRAINING_BLACK_SHORT (8)
+#define TRAINING_BLACK_LONG (16)
+
+typedef struct {
+    // Two squares per byte, square 2i in the low nibble of byte i. A nibble
+    // is the piece type (PAWN...KING), plus 8 for black pieces.
+    unsigned char squares[BOARD_DIM * BOARD_DIM / 2];
+    short score;                    // Centipawns, for the side to move.
+    signed char result;             // 1 if white won the game, -1 if black did, 0 for a draw.
+    unsigned char flags;
+    unsigned char ep_square;        // En passant target square, 64 for none.
+    unsigned char half_move_clock;
+    unsigned short move_count;
+} TrainingRecord;
+
+_Static_assert(sizeof(TrainingRecord) == 40, "training records must not contain padding");
+
+
+void pack_record(Board *board, int score, int result, TrainingRecord *record);
+void record_to_FEN(TrainingRecord *record, char *fen);
+
+#endif